@@ -1,8 +1,11 @@
+// 统计 "alloc": true 调用中的堆分配，只能在一个源文件中定义
+#define UNITAUTO_ALLOC_HOOK
 #include "unitauto/method_util.hpp"
 // #include "unitauto/server.hpp"
 #include <iostream>
 
 #include "unitauto/test/test_util.hpp"
+#include "unitauto/test/http_test.hpp"
 
 using json = unitauto::json;
 
@@ -116,6 +119,15 @@ Moment newMoment(long id) {
     return Moment(id);
 }
 
+std::vector<Moment> newMoments(long count) {
+    std::vector<Moment> moments;
+    moments.reserve(count);
+    for (long i = 1; i <= count; ++i) {
+        moments.emplace_back(i);
+    }
+    return moments;
+}
+
 User newUser(long id, std::string name) {
     User u = User();
     u.id = id;
@@ -217,7 +229,13 @@ int test() {
         unitauto::printlnErr("Type match error, have u added type with add_ptr?");
     }
 
-    return 0;
+    // HTTP 解析、Accept 协商、ETag 的回归检查
+    int failed = unitauto::test::test_http();
+    if (failed > 0) {
+        unitauto::printlnErr("HTTP checks failed: ", failed);
+    }
+
+    return failed;
 }
 
 
@@ -239,6 +257,7 @@ int main() {
 
     // 自定义注册函数路径
     unitauto::add_func("main.newMoment", std::function(newMoment));
+    unitauto::add_func("main.newMoments", std::function(newMoments));
     unitauto::add_func("main.newUser", std::function(newUser));
     unitauto::add_func("main.compare", std::function(compare));
     unitauto::add_func("Person.testStatic", std::function(Person::testStatic));
@@ -23,15 +23,46 @@ limitations under the License.*/
 #include <iostream>
 #include <vector>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <cstring>
+#include <cerrno>
 #include <typeinfo>
 #include <cxxabi.h>
+#include <typeindex>
+#include <optional>
 #include <fstream>
 #include <cstdlib> // for system()
 #include<csignal>
 #include <regex>
 #include <chrono>
+#include <cmath>
+#include <memory>
+#include <cctype>
+#include <charconv>
+#include <ctime>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <fcntl.h>
+#include <strings.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+// 定义 UNITAUTO_ZLIB 并链接 zlib 后，按 Accept-Encoding 压缩响应体
+#ifdef UNITAUTO_ZLIB
+#include <zlib.h>
+#endif
 
 /**@author Lemon
  */
@@ -103,6 +134,222 @@ namespace unitauto {
         print("\n");
     }
 
+    // 日志 <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+    // 不用 LOG_DEBUG 等命名，避免与 <syslog.h> 的同名宏冲突
+    enum LogLevel {
+        LEVEL_DEBUG = 0,
+        LEVEL_INFO = 1,
+        LEVEL_WARN = 2,
+        LEVEL_ERROR = 3
+    };
+
+    static const char* log_level_name(LogLevel level) {
+        switch (level) {
+            case LEVEL_DEBUG: return "DEBUG";
+            case LEVEL_INFO: return "INFO";
+            case LEVEL_WARN: return "WARN";
+            default: return "ERROR";
+        }
+    }
+
+    // 异步日志：调用线程只把日志放进无锁环形队列(有界多生产者队列)，由后台线程批量写出并 flush，
+    // 队列满时丢弃并计数，不阻塞调用线程；后台线程没有日志时等待条件变量，只有它在等待时调用线程才加锁通知
+    class AsyncLogger {
+    public:
+        static constexpr size_t CAPACITY = 4096; // 必须是 2 的幂
+
+        AsyncLogger() : slots_(new Slot[CAPACITY]) {
+            for (size_t i = 0; i < CAPACITY; ++i) {
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+            }
+            thread_ = std::thread([this] { drain(); });
+        }
+
+        ~AsyncLogger() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped_.store(true, std::memory_order_release);
+            }
+            cv_.notify_one();
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+
+        AsyncLogger(const AsyncLogger&) = delete;
+        AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+        bool push(LogLevel level, std::string msg) {
+            size_t pos = tail_.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots_[pos & (CAPACITY - 1)];
+                size_t seq = slot->seq.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->level = level;
+            slot->time = std::chrono::system_clock::now();
+            slot->msg = std::move(msg);
+            slot->seq.store(pos + 1, std::memory_order_release);
+
+            // 与 drain 中的栅栏配对：要么后台线程能看到这条日志，要么这里能看到它在等待
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting_.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cv_.notify_one();
+            }
+            return true;
+        }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> seq{0};
+            LogLevel level = LEVEL_INFO;
+            std::chrono::system_clock::time_point time;
+            std::string msg;
+        };
+
+        // 只在后台线程中执行，没有日志时等待通知，停止时写完剩余的日志再退出
+        void drain() {
+            while (true) {
+                bool stopping = stopped_.load(std::memory_order_acquire);
+                if (write_batch() > 0) {
+                    continue;
+                }
+                if (stopping) {
+                    return;
+                }
+
+                waiting_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this] {
+                        return pending() || stopped_.load(std::memory_order_acquire);
+                    });
+                }
+                waiting_.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        // 队首是否有已写完的日志
+        bool pending() const {
+            return slots_[head_ & (CAPACITY - 1)].seq.load(std::memory_order_acquire) == head_ + 1;
+        }
+
+        size_t write_batch() {
+            size_t n = 0;
+            bool has_out = false;
+            bool has_err = false;
+            while (n < CAPACITY) {
+                Slot& slot = slots_[head_ & (CAPACITY - 1)];
+                if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+                    break;
+                }
+
+                std::ostream& out = slot.level >= LEVEL_WARN ? std::cerr : std::cout;
+                (slot.level >= LEVEL_WARN ? has_err : has_out) = true;
+
+                std::time_t t = std::chrono::system_clock::to_time_t(slot.time);
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(slot.time.time_since_epoch()).count() % 1000;
+                std::tm tm{};
+                localtime_r(&t, &tm);
+                char time_str[32];
+                std::strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm);
+                out << time_str << "." << std::setw(3) << std::setfill('0') << ms << " " << log_level_name(slot.level) << " " << slot.msg << "\n";
+
+                slot.msg.clear();
+                slot.seq.store(head_ + CAPACITY, std::memory_order_release);
+                head_ ++;
+                n ++;
+            }
+
+            size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                std::cerr << "WARN " << dropped << " log messages dropped, log queue is full\n";
+                has_err = true;
+            }
+
+            if (has_out) {
+                std::cout.flush();
+            }
+            if (has_err) {
+                std::cerr.flush();
+            }
+            return n;
+        }
+
+        std::unique_ptr<Slot[]> slots_;
+        std::atomic<size_t> tail_{0};
+        size_t head_ = 0; // 只有后台线程访问
+        std::atomic<size_t> dropped_{0};
+        std::atomic<bool> stopped_{false};
+        std::atomic<bool> waiting_{false}; // 后台线程是否在等待通知
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread thread_;
+    };
+
+    // 第一次写日志时创建，程序退出时写完剩余的日志
+    static AsyncLogger& logger() {
+        static AsyncLogger instance;
+        return instance;
+    }
+
+    template<typename... Args>
+    static void log_write(LogLevel level, const Args&... args) {
+        std::ostringstream ss;
+        (ss << ... << args);
+        logger().push(level, ss.str());
+    }
+
+    // 编译期日志级别，低于它的日志连同格式化一起被去掉，例如 -DUNITAUTO_LOG_LEVEL=0 打开 DEBUG 日志
+#ifndef UNITAUTO_LOG_LEVEL
+#define UNITAUTO_LOG_LEVEL 1
+#endif
+
+    template<typename... Args>
+    static void log_debug(const Args&... args) {
+        if constexpr (UNITAUTO_LOG_LEVEL <= LEVEL_DEBUG) {
+            log_write(LEVEL_DEBUG, args...);
+        }
+    }
+
+    template<typename... Args>
+    static void log_info(const Args&... args) {
+        if constexpr (UNITAUTO_LOG_LEVEL <= LEVEL_INFO) {
+            log_write(LEVEL_INFO, args...);
+        }
+    }
+
+    template<typename... Args>
+    static void log_warn(const Args&... args) {
+        if constexpr (UNITAUTO_LOG_LEVEL <= LEVEL_WARN) {
+            log_write(LEVEL_WARN, args...);
+        }
+    }
+
+    template<typename... Args>
+    static void log_error(const Args&... args) {
+        if constexpr (UNITAUTO_LOG_LEVEL <= LEVEL_ERROR) {
+            log_write(LEVEL_ERROR, args...);
+        }
+    }
+
+    // 日志 >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+
     // 用于解码类型名称的函数
     static std::string demangle(const char* name) {
         int status = 0;
@@ -140,14 +387,50 @@ namespace unitauto {
     static const std::string TYPE_DOUBLE_ARR = "double[]"; // typeid(double).name();
     static const std::string TYPE_STRING_ARR = "string[]"; // typeid(std::string).name();
 
-    std::string trim_type(std::string type) {
-        type = std::regex_replace(type, std::regex(DEFAULT_MODULE_PATH + "::"), "");
-        type = std::regex_replace(type, std::regex(DEFAULT_MODULE_PATH + "."), "");
-        type = std::regex_replace(type, std::regex("std::"), "");
-        type = std::regex_replace(type, std::regex("std."), "");
-        type = std::regex_replace(type, std::regex("__1::"), "");
-        type = std::regex_replace(type, std::regex("__1."), "");
-        type = std::regex_replace(type, std::regex("::"), ".");
+    // 在 type 的 i 位置是否为 prefix 后跟 :: 或 .，是则返回要跳过的长度，否则返回 0
+    static size_t match_namespace(const std::string& type, size_t i, const std::string& prefix) {
+        size_t n = prefix.size();
+        if (n == 0 || type.compare(i, n, prefix) != 0) {
+            return 0;
+        }
+        if (type.compare(i + n, 2, "::") == 0) {
+            return n + 2;
+        }
+        if (i + n < type.size() && type[i + n] == '.') {
+            return n + 1;
+        }
+        return 0;
+    }
+
+    // 单次遍历去掉 DEFAULT_MODULE_PATH, std, __1 等命名空间前缀，并把 :: 转为 .
+    static std::string _trim_type(const std::string& raw) {
+        static const std::string STD = "std";
+        static const std::string LIBCPP = "__1";
+
+        std::string type;
+        type.reserve(raw.size());
+        for (size_t i = 0; i < raw.size();) {
+            size_t skip = match_namespace(raw, i, DEFAULT_MODULE_PATH);
+            if (skip == 0) {
+                skip = match_namespace(raw, i, STD);
+            }
+            if (skip == 0) {
+                skip = match_namespace(raw, i, LIBCPP);
+            }
+            if (skip > 0) {
+                i += skip;
+                continue;
+            }
+
+            if (raw.compare(i, 2, "::") == 0) {
+                type += '.';
+                i += 2;
+                continue;
+            }
+
+            type += raw[i];
+            i ++;
+        }
 
         if (type.empty() || type == "v" || type == "Dn" || type == "NULL" || type == "null" || type == "nullptr" || type == "nullptr_t") {
             return "";
@@ -175,60 +458,210 @@ namespace unitauto {
             return TYPE_DOUBLE;
         }
 
-        while (! type.empty()) {
-            char c = type.at(0);
-            if (c >= '0' && c <= '9') {
-                type = type.substr(1);
-            } else {
-                break;
+        size_t digits = 0;
+        while (digits < type.size() && type[digits] >= '0' && type[digits] <= '9') {
+            digits ++;
+        }
+        if (digits > 0) {
+            type.erase(0, digits);
+        }
+
+        return type;
+    }
+
+    static std::shared_mutex TRIM_TYPE_MUTEX;
+    // trim_type 结果缓存，key 为原始类型名；DEFAULT_MODULE_PATH 变化后清空
+    static std::unordered_map<std::string, std::string> TRIM_TYPE_CACHE;
+    static std::string TRIM_TYPE_MODULE_PATH;
+    // 请求中的 type 也会经过 trim_type，限制缓存大小，避免被任意字符串撑大
+    static const size_t TRIM_TYPE_CACHE_MAX = 4096;
+
+    std::string trim_type(std::string type) {
+        {
+            std::shared_lock<std::shared_mutex> lock(TRIM_TYPE_MUTEX);
+            if (TRIM_TYPE_MODULE_PATH == DEFAULT_MODULE_PATH) {
+                auto it = TRIM_TYPE_CACHE.find(type);
+                if (it != TRIM_TYPE_CACHE.end()) {
+                    return it->second;
+                }
+            }
+        }
+
+        std::string t = _trim_type(type);
+
+        std::unique_lock<std::shared_mutex> lock(TRIM_TYPE_MUTEX);
+        if (TRIM_TYPE_MODULE_PATH != DEFAULT_MODULE_PATH || TRIM_TYPE_CACHE.size() >= TRIM_TYPE_CACHE_MAX) {
+            TRIM_TYPE_CACHE.clear();
+            TRIM_TYPE_MODULE_PATH = DEFAULT_MODULE_PATH;
+        }
+        TRIM_TYPE_CACHE.emplace(std::move(type), t);
+        return t;
+    }
+
+    static std::shared_mutex TYPE_NAME_MUTEX;
+    // 类型 -> 规范化名称，按需填充，add_cast/add_val/add_ptr/add_func 注册时预先填充；
+    // 名称依赖 DEFAULT_MODULE_PATH，它变化后清空
+    static std::unordered_map<std::type_index, std::string> TYPE_NAME_MAP;
+    static std::string TYPE_NAME_MODULE_PATH;
+
+    // 取类型的规范化名称，DEFAULT_MODULE_PATH 不变时每个类型只 demangle + trim_type 一次
+    static std::string type_name(const std::type_info& ti) {
+        std::type_index key(ti);
+        {
+            std::shared_lock<std::shared_mutex> lock(TYPE_NAME_MUTEX);
+            if (TYPE_NAME_MODULE_PATH == DEFAULT_MODULE_PATH) {
+                auto it = TYPE_NAME_MAP.find(key);
+                if (it != TYPE_NAME_MAP.end()) {
+                    return it->second;
+                }
             }
         }
 
+        std::string type = trim_type(demangle(ti.name()));
+
+        std::unique_lock<std::shared_mutex> lock(TYPE_NAME_MUTEX);
+        if (TYPE_NAME_MODULE_PATH != DEFAULT_MODULE_PATH) {
+            TYPE_NAME_MAP.clear();
+            TYPE_NAME_MODULE_PATH = DEFAULT_MODULE_PATH;
+        }
+        TYPE_NAME_MAP.emplace(key, type);
         return type;
     }
 
-    std::string get_type(std::any a) {
-        auto type = demangle(a.type().name()); // typeid(a).name();  // TYPE.name();
-        type = trim_type(type);
+    template<typename T>
+    static std::string type_name() {
+        return type_name(typeid(T));
+    }
+
+    // 注册函数时预先填充返回值与参数类型的名称，避免调用时再 demangle
+    template<typename... Ts>
+    static void seed_type_names() {
+        (type_name(typeid(std::decay_t<Ts>)), ...);
+    }
+
+    std::string get_type(const std::any& a) {
+        auto type = type_name(a.type()); // typeid(a).name();  // TYPE.name();
         if (type.empty()) {
-            type = demangle(typeid(a.type()).name());
-            type = trim_type(type);
+            type = type_name(typeid(a.type()));
         }
         return type;
     }
 
+    // 注册表读写锁，保护 CAST_MAP, TYEP_ALIAS_MAP, PTR_MAP, VAL_MAP, FUNC_MAP 等；
+    // 读取时只在锁内复制出回调，释放锁后再执行，避免被测函数内再次查表时死锁
+    static std::shared_mutex REGISTRY_MUTEX;
+
     static std::map<std::string, std::string> TYEP_ALIAS_MAP;
 
+    // 按类型名及其别名查找已注册的回调，返回副本，找不到时返回空的 std::function；
+    // 只用 find，不会像 operator[] 那样在读取时插入新元素
+    template<typename Map>
+    static typename Map::mapped_type find_registered(const Map& map, const std::string& type) {
+        std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        auto it = map.find(type);
+        if (it == map.end()) {
+            auto ait = TYEP_ALIAS_MAP.find(type);
+            if (ait != TYEP_ALIAS_MAP.end() && ait->second != type && ! ait->second.empty()) {
+                it = map.find(ait->second);
+            }
+        }
+        return it == map.end() ? typename Map::mapped_type() : it->second;
+    }
+
     // 类型转换函数映射
     // template<typename T >
     static std::map<std::string, std::function<json(std::any)>> CAST_MAP;
 
-    // 注册类型转换函数
+    // 内置类型转 JSON，用 any_cast 指针取值，避免复制
     template<typename T>
-    void add_cast(std::string type, json caster(std::any val)) {
-        CAST_MAP[type] = caster != nullptr ? caster : [](std::any value) -> json {
-            json j;
-            try {
-                j = std::any_cast<T>(value); // j = json::parse(value);
+    static json builtin_to_json(const std::any& value) {
+        return *std::any_cast<T>(&value);
+    }
+
+    // 类型 -> 转 JSON 函数，包含内置类型及 add_cast 注册的类型，any_to_json 按 value.type() 一次查找
+    static std::unordered_map<std::type_index, std::function<json(const std::any&)>> TYPE_CAST_MAP = {
+        {typeid(bool), builtin_to_json<bool>},
+        {typeid(std::byte), builtin_to_json<std::byte>},
+        {typeid(char), builtin_to_json<char>},
+        {typeid(short), builtin_to_json<short>},
+        {typeid(int), builtin_to_json<int>},
+        {typeid(long), builtin_to_json<long>},
+        {typeid(long long), builtin_to_json<long long>},
+        {typeid(float), builtin_to_json<float>},
+        {typeid(double), builtin_to_json<double>},
+        {typeid(std::string), builtin_to_json<std::string>},
+
+        {typeid(std::vector<bool>), builtin_to_json<std::vector<bool>>},
+        {typeid(std::vector<char>), builtin_to_json<std::vector<char>>},
+        {typeid(std::vector<std::byte>), builtin_to_json<std::vector<std::byte>>},
+        {typeid(std::vector<short>), builtin_to_json<std::vector<short>>},
+        {typeid(std::vector<int>), builtin_to_json<std::vector<int>>},
+        {typeid(std::vector<long>), builtin_to_json<std::vector<long>>},
+        {typeid(std::vector<long long>), builtin_to_json<std::vector<long long>>},
+        {typeid(std::vector<float>), builtin_to_json<std::vector<float>>},
+        {typeid(std::vector<double>), builtin_to_json<std::vector<double>>},
+        {typeid(std::vector<std::string>), builtin_to_json<std::vector<std::string>>},
+
+        {typeid(std::map<std::string, bool>), builtin_to_json<std::map<std::string, bool>>},
+        {typeid(std::map<std::string, std::byte>), builtin_to_json<std::map<std::string, std::byte>>},
+        {typeid(std::map<std::string, char>), builtin_to_json<std::map<std::string, char>>},
+        {typeid(std::map<std::string, short>), builtin_to_json<std::map<std::string, short>>},
+        {typeid(std::map<std::string, int>), builtin_to_json<std::map<std::string, int>>},
+        {typeid(std::map<std::string, long>), builtin_to_json<std::map<std::string, long>>},
+        {typeid(std::map<std::string, long long>), builtin_to_json<std::map<std::string, long long>>},
+        {typeid(std::map<std::string, std::string>), builtin_to_json<std::map<std::string, std::string>>}
+    };
+
+    static std::function<json(const std::any&)> find_type_cast(const std::type_info& ti) {
+        std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        auto it = TYPE_CAST_MAP.find(std::type_index(ti));
+        return it == TYPE_CAST_MAP.end() ? nullptr : it->second;
+    }
+
+    // add_cast 没传 caster 时的默认转 JSON 函数，用 any_cast 指针取值，避免复制
+    template<typename T>
+    static json cast_to_json(const std::any& value) {
+        json j;
+        try {
+            // 按类型名查找时 value 不一定是 T，any_cast 返回空指针
+            const T* ptr = std::any_cast<T>(&value);
+            if (ptr != nullptr) {
+                j = *ptr; // j = json::parse(value);
                 return j;
-            } catch (const nlohmann::json::parse_error& ex) {
-                std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-            } catch (const nlohmann::json::type_error& ex) {
-                std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-            } catch (const nlohmann::json::other_error& ex) {
-                std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
-            } catch (const std::exception& e) {
-                std::cout << "add_cast j.dump() >> std::exceptione " << e.what() << std::endl;
             }
+        } catch (const nlohmann::json::parse_error& ex) {
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+        } catch (const nlohmann::json::type_error& ex) {
+            log_debug("nlohmann::json::type_error ", ex.what());
+        } catch (const nlohmann::json::other_error& ex) {
+            log_debug("nlohmann::json::other_error ", ex.what());
+        } catch (const std::exception& e) {
+            log_debug("add_cast j.dump() >> std::exception ", e.what());
+        }
 
-            std::stringstream ss;
-            ss << &value;
-            j["type"] = get_type(value);
-            j["value"] = ss.str();
-            return j;
-        };
+        std::stringstream ss;
+        ss << &value;
+        j["type"] = get_type(value);
+        j["value"] = ss.str();
+        return j;
+    }
+
+    // 注册类型转换函数
+    template<typename T>
+    void add_cast(std::string type, json caster(std::any val)) {
+        std::string t = type_name<T>();
+
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        // CAST_MAP 按类型名查找，TYPE_CAST_MAP 按 typeid 查找，默认函数直接按 const 引用取值；
+        // 自定义 caster 的参数是按值传的，只能在调用时复制
+        if (caster != nullptr) {
+            CAST_MAP[type] = caster;
+            TYPE_CAST_MAP[std::type_index(typeid(T))] = caster;
+        } else {
+            CAST_MAP[type] = cast_to_json<T>;
+            TYPE_CAST_MAP[std::type_index(typeid(T))] = cast_to_json<T>;
+        }
 
-        std::string t = trim_type(demangle(typeid(T).name()));
         if (t != type) {
             CAST_MAP[t] = CAST_MAP[type];
             TYEP_ALIAS_MAP[t] = type;
@@ -247,16 +680,9 @@ namespace unitauto {
     // JSON 字符串转对应类型的值对象
     template<typename T>
     static T json_2_val(json &j, const std::string& type) {
-        auto it = VAL_MAP.find(type);
-        if (it == VAL_MAP.end()) {
-            std::string t = TYEP_ALIAS_MAP[type];
-            if (t != type && ! t.empty()) {
-                it = VAL_MAP.find(t);
-            }
-        }
-
-        if (it != VAL_MAP.end()) {
-            auto val = it->second(j);
+        auto getter = find_registered(VAL_MAP, type);
+        if (getter) {
+            auto val = getter(j);
             return std::any_cast<T>(val);
         }
 
@@ -266,16 +692,9 @@ namespace unitauto {
     // JSON 字符串转对应类型的对象
     template<typename T>
     static T* json_2_obj(json &j, const std::string& type) {
-        auto it = PTR_MAP.find(type);
-        if (it == PTR_MAP.end()) {
-            std::string t = TYEP_ALIAS_MAP[type];
-            if (t != type && ! t.empty()) {
-                it = PTR_MAP.find(t);
-            }
-        }
-
-        if (it != PTR_MAP.end()) {
-            auto val = it->second(j);
+        auto getter = find_registered(PTR_MAP, type);
+        if (getter) {
+            auto val = getter(j);
             return static_cast<T*>(val);
         }
 
@@ -294,16 +713,9 @@ namespace unitauto {
 
     // JSON 字符串转对应类型的对象
     static std::any json_2_any(json &j, const std::string& type) {
-        auto it = VAL_MAP.find(type);
-        if (it == VAL_MAP.end()) {
-            std::string t = TYEP_ALIAS_MAP[type];
-            if (t != type && ! t.empty()) {
-                it = VAL_MAP.find(t);
-            }
-        }
-
-        if (it != VAL_MAP.end()) {
-            return it->second(j);
+        auto getter = find_registered(VAL_MAP, type);
+        if (getter) {
+            return getter(j);
         }
 
         throw std::runtime_error("Unknown type: "+ type + ", call add_ptr firstly!");
@@ -318,40 +730,26 @@ namespace unitauto {
             type = type2;
         }
 
-        auto it = CAST_MAP.find(type);
-        if (it == CAST_MAP.end()) {
-            std::string t = TYEP_ALIAS_MAP[type];
-            if (t != type && ! t.empty()) {
-                it = CAST_MAP.find(t);
-            }
-
-            if (it == CAST_MAP.end()) {
-                it = CAST_MAP.find(type2);
-
-                if (it == CAST_MAP.end()) {
-                    t = TYEP_ALIAS_MAP[type2];
-                    if (t != type2 && ! t.empty()) {
-                        it = CAST_MAP.find(t);
-                    }
-                }
-            }
+        auto caster = find_registered(CAST_MAP, type);
+        if (! caster && type2 != type) {
+            caster = find_registered(CAST_MAP, type2);
         }
 
-        if (it != CAST_MAP.end()) {
-            return it->second(value);
+        if (caster) {
+            return caster(value);
         }
 
         try {
             auto j = std::any_cast<json>(value);
             return j;
         } catch (const nlohmann::json::parse_error& ex) {
-            std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
         } catch (const nlohmann::json::type_error& ex) {
-            std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
+            log_debug("nlohmann::json::type_error ", ex.what());
         } catch (const nlohmann::json::other_error& ex) {
-            std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
+            log_debug("nlohmann::json::other_error ", ex.what());
         } catch (const std::exception& e) {
-            std::cout << "add_cast j.dump() >> std::exceptione " << e.what() << std::endl;
+            log_debug("add_cast j.dump() >> std::exception ", e.what());
         }
 
         std::stringstream ss;
@@ -372,169 +770,168 @@ namespace unitauto {
             // return nullptr;
         }
 
-        try {
-            if (value.type() == typeid(bool)) {
-                return std::any_cast<bool>(value);
-            }
-            if (value.type() == typeid(std::byte)) {
-                return std::any_cast<std::byte>(value);
-            }
-            if (value.type() == typeid(char)) {
-                return std::any_cast<char>(value);
-            }
-            if (value.type() == typeid(short)) {
-                return std::any_cast<short>(value);
-            }
-            if (value.type() == typeid(int)) {
-                return std::any_cast<int>(value);
-            }
-            if (value.type() == typeid(long)) {
-                return std::any_cast<long>(value);
-            }
-            if (value.type() == typeid(long long)) {
-                return std::any_cast<long long>(value);
-            }
-            if (value.type() == typeid(float)) {
-                return std::any_cast<float>(value);
-            }
-            if (value.type() == typeid(double)) {
-                return std::any_cast<double>(value);
-            }
-            if (value.type() == typeid(std::string)) {
-                return std::any_cast<std::string>(value);
+        auto caster = find_type_cast(value.type());
+        if (caster) {
+            try {
+                return caster(value);
+            } catch (const nlohmann::json::parse_error& ex) {
+                log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+            } catch (const nlohmann::json::type_error& ex) {
+                log_debug("nlohmann::json::type_error ", ex.what());
+            } catch (const nlohmann::json::other_error& ex) {
+                log_debug("nlohmann::json::other_error ", ex.what());
+            } catch (const std::exception& e) {
+                log_debug(e.what());
             }
+        }
 
-            // if (value.type() == typeid(bool&)) {
-            //     return std::any_cast<bool&>(value);
-            // }
-            // if (value.type() == typeid(std::byte&)) {
-            //     return std::any_cast<std::byte&>(value);
-            // }
-            // if (value.type() == typeid(char&)) {
-            //     return std::any_cast<char&>(value);
-            // }
-            // if (value.type() == typeid(short&)) {
-            //     return std::any_cast<short&>(value);
-            // }
-            // if (value.type() == typeid(int&)) {
-            //     return std::any_cast<int&>(value);
-            // }
-            // if (value.type() == typeid(long&)) {
-            //     return std::any_cast<long&>(value);
-            // }
-            // if (value.type() == typeid(long long&)) {
-            //     return std::any_cast<long long&>(value);
-            // }
-            // if (value.type() == typeid(float&)) {
-            //     return std::any_cast<float&>(value);
-            // }
-            // if (value.type() == typeid(double&)) {
-            //     return std::any_cast<double&>(value);
-            // }
-            // if (value.type() == typeid(std::string&)) {
-            //     return std::any_cast<std::string&>(value);
-            // }
+        return _any_to_json(value, type);
+    }
 
-            if (value.type() == typeid(std::vector<bool>)) {
-                return std::any_cast<std::vector<bool>>(value);
-            }
-            if (value.type() == typeid(std::vector<char>)) {
-                return std::any_cast<std::vector<char>>(value);
-            }
-            if (value.type() == typeid(std::vector<std::byte>)) {
-                return std::any_cast<std::vector<std::byte>>(value);
-            }
-            if (value.type() == typeid(std::vector<short>)) {
-                return std::any_cast<short>(value);
-            }
-            if (value.type() == typeid(std::vector<int>)) {
-                return std::any_cast<std::vector<int>>(value);
-            }
-            if (value.type() == typeid(std::vector<long>)) {
-                return std::any_cast<std::vector<long>>(value);
-            }
-            if (value.type() == typeid(std::vector<long long>)) {
-                return std::any_cast<std::vector<long long>>(value);
-            }
-            if (value.type() == typeid(std::vector<float>)) {
-                return std::any_cast<std::vector<float>>(value);
-            }
-            if (value.type() == typeid(std::vector<double>)) {
-                return std::any_cast<std::vector<double>>(value);
-            }
-            if (value.type() == typeid(std::vector<std::string>)) {
-                return std::any_cast<std::vector<std::string>>(value);
-            }
-            // if (value.type() == typeid(std::vector<std::any>)) {
-            //     return (std::vector<std::any>) value; //  std::any_cast<std::vector<std::any>>(value);
-            // }
+    // 按已注册的类型依次尝试转换，先 add_ptr 注册的(得到指针)，再 add_val 注册的(得到值)，
+    // 都没注册时返回 false，不通过抛出再捕获异常来回退
+    static bool try_json_2_any(json &j, const std::string &type, std::any &out) {
+        std::function<void*(json &j)> ptr_getter;
+        std::function<std::any(json &j)> val_getter;
+        {
+            std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+            std::string t = type;
+            auto ait = TYEP_ALIAS_MAP.find(type);
+            for (int i = 0; i < 2 && ! ptr_getter && ! val_getter; ++i) {
+                auto pit = PTR_MAP.find(t);
+                if (pit != PTR_MAP.end()) {
+                    ptr_getter = pit->second;
+                    break;
+                }
+                auto vit = VAL_MAP.find(t);
+                if (vit != VAL_MAP.end()) {
+                    val_getter = vit->second;
+                    break;
+                }
 
-            if (value.type() == typeid(std::map<std::string, bool>)) {
-                return std::any_cast<std::map<std::string, bool>>(value);
-            }
-            if (value.type() == typeid(std::map<std::string, std::byte>)) {
-                return std::any_cast<std::map<std::string, std::byte>>(value);
-            }
-            if (value.type() == typeid(std::map<std::string, char>)) {
-                return std::any_cast<std::map<std::string, char>>(value);
-            }
-            if (value.type() == typeid(std::map<std::string, short>)) {
-                return std::any_cast<std::map<std::string, short>>(value);
-            }
-            if (value.type() == typeid(std::map<std::string, int>)) {
-                return std::any_cast<std::map<std::string, int>>(value);
-            }
-            if (value.type() == typeid(std::map<std::string, long>)) {
-                return std::any_cast<std::map<std::string, long>>(value);
+                if (ait == TYEP_ALIAS_MAP.end() || ait->second.empty() || ait->second == type) {
+                    break;
+                }
+                t = ait->second;
             }
-            if (value.type() == typeid(std::map<std::string, long long>)) {
-                return std::any_cast<std::map<std::string, long long>>(value);
+        }
+
+        if (ptr_getter) {
+            out = static_cast<std::any*>(ptr_getter(j));
+            return true;
+        }
+        if (val_getter) {
+            out = val_getter(j);
+            return true;
+        }
+        return false;
+    }
+
+    // JSON 值是否可以无异常地 get<T>()
+    template<typename T>
+    static bool json_is(const json &v) {
+        if constexpr (std::is_same_v<T, bool>) {
+            return v.is_boolean();
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            return v.is_string();
+        } else if constexpr (std::is_same_v<T, std::byte>) {
+            return v.is_number_unsigned() && v.get<uint64_t>() <= 0xFF;
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            return v.is_number();
+        } else {
+            if (! v.is_array()) {
+                return false;
             }
-            if (value.type() == typeid(std::map<std::string, std::string>)) {
-                return std::any_cast<std::map<std::string, std::string>>(value);
+            for (const auto &item : v) {
+                if (! json_is<typename T::value_type>(item)) {
+                    return false;
+                }
             }
-            // if (value.type() == typeid(std::map<std::string, std::any>)) {
-            //     return std::any_cast<std::map<std::string, std::any>>(value);
-            // }
-        } catch (const nlohmann::json::parse_error& ex) {
-            std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-        } catch (const nlohmann::json::type_error& ex) {
-            std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-        } catch (const nlohmann::json::other_error& ex) {
-            std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
-        } catch (const std::exception& e) {
-            std::cout << e.what() << std::endl;
+            return true;
+        }
+    }
+
+    template<typename T>
+    static bool json_get(const json &v, std::any &out, std::string &err, const std::string &type) {
+        if (! json_is<T>(v)) {
+            err = v.dump() + " cannot be cast to " + type + "!";
+            return false;
         }
+        out = v.get<T>();
+        return true;
+    }
 
-        return _any_to_json(value, type);
+    // T[] 类型取第一个元素
+    template<typename T>
+    static bool json_get_first(const json &v, std::any &out, std::string &err, const std::string &type) {
+        if (! json_is<std::vector<T>>(v) || v.empty()) {
+            err = v.dump() + " cannot be cast to " + type + "! should be a non-empty array!";
+            return false;
+        }
+        out = v.front().get<T>();
+        return true;
     }
 
-    static std::any json_to_any(json &j) {
+    // 解析 "int:1" 这类字符串中的数值，不抛异常
+    template<typename T>
+    static bool parse_number(const std::string &s, std::any &out, std::string &err, const std::string &type) {
+        T v{};
+        const char* begin = s.data();
+        const char* end = begin + s.size();
+        // 与原来的 std::stoi/std::stod 一样允许前后空白和开头的 '+'，但整个字符串都必须是数字
+        while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) {
+            ++begin;
+        }
+        while (end > begin && std::isspace(static_cast<unsigned char>(end[-1]))) {
+            --end;
+        }
+        if (end - begin > 1 && *begin == '+' && begin[1] != '-' && begin[1] != '+') {
+            ++begin;
+        }
+
+        std::from_chars_result r;
+        if constexpr (std::is_floating_point_v<T>) {
+            r = std::from_chars(begin, end, v, std::chars_format::general);
+        } else {
+            r = std::from_chars(begin, end, v);
+        }
+        if (r.ec != std::errc() || r.ptr != end) {
+            err = s + " cannot be cast to " + type + "!";
+            return false;
+        }
+        out = v;
+        return true;
+    }
+
+    // JSON 转 std::any，转换失败时返回 false 并设置 err，不抛异常；
+    // 已注册类型的转换函数自身抛出的异常(例如 JSON 字段类型不匹配)仍会抛出
+    static bool try_json_to_any(json &j, std::any &out, std::string &err) {
         if (j.is_null()) {
-            return nullptr;
+            out = nullptr;
+            return true;
         }
 
         if (j.is_number_integer()) {
-            return j.get<long>();
+            out = j.get<long>();
+            return true;
         }
 
         if (j.is_number_float()) {
-            return j.get<float>();
+            out = j.get<float>();
+            return true;
         }
 
         if (j.is_number()) {
-            return j.get<double>();
+            out = j.get<double>();
+            return true;
         }
 
         if (j.is_string()) {
-            // return j.get<std::string>();
-            std::string val = j.get<std::string>();
+            const std::string &val = j.get_ref<const std::string&>();
             size_t ind = val.find(':');
-            // const char *s = val.c_str();
-            // auto pc = strchr(s, ':');
-            // int ind = pc - s;
-            if (ind == std::string::npos || ind < 0) {
-                return val;
+            if (ind == std::string::npos) {
+                out = val;
+                return true;
             }
 
             std::string type = val.substr(0, ind);
@@ -542,263 +939,197 @@ namespace unitauto {
 
             if (type == TYPE_ANY) {
                 if (vs == "nullptr") { // || vs == "null") {
-                    return nullptr;
-                }
-                if (vs == "NULL") {
-                    return NULL;
+                    out = nullptr;
+                } else if (vs == "NULL") {
+                    out = NULL;
+                } else {
+                    out = vs;
                 }
-                return vs;
+                return true;
             }
             if (type == TYPE_BOOL) {
-                if (vs == "true") {
+                if (vs == "true" || vs == "false") {
+                    out = vs == "true";
                     return true;
                 }
-                if (vs == "false") { //  || vs == "") {
-                    return false;
-                }
-                throw vs + " cannot be cast to bool! only true, false illegal!";
+                err = vs + " cannot be cast to bool! only true, false illegal!";
+                return false;
             }
             if (type == TYPE_CHAR) {
                 if (vs.size() != 1) {
-                    throw vs + " size != 1 ! cannot be cast to char!";
+                    err = vs + " size != 1 ! cannot be cast to char!";
+                    return false;
                 }
-                return vs.at(0);
+                out = vs.at(0);
+                return true;
             }
             if (type == TYPE_BYTE || type == TYPE_SHORT || type == TYPE_INT) {
-                return std::stoi(vs);
+                return parse_number<int>(vs, out, err, type);
             }
             if (type == TYPE_LONG) {
-                return std::stol(vs);
+                return parse_number<long>(vs, out, err, type);
             }
             if (type == TYPE_LONG_LONG) {
-                return std::stoll(vs);
+                return parse_number<long long>(vs, out, err, type);
             }
             if (type == TYPE_FLOAT) {
-                return std::stof(vs);
+                return parse_number<float>(vs, out, err, type);
             }
             if (type == TYPE_DOUBLE) {
-                return std::stod(vs);
+                return parse_number<double>(vs, out, err, type);
             }
             if (type == TYPE_STRING) {
-                return vs;
+                out = vs;
+                return true;
             }
 
-            json j = vs;
-            try {
-                return json_2_obj<std::any>(j, type);
-            } catch (const std::exception& e) {
-                printlnErr(get_type(e), ": ", e.what());
-                return json_2_any(j, type);
+            json v = vs;
+            if (try_json_2_any(v, type, out)) {
+                return true;
             }
+            err = "Unknown type: " + type + ", call add_type/add_class/add_struct/add_ptr/add_val firstly!";
+            return false;
         }
 
         if (j.is_object()) {
-            json type = j["type"];
-            if (type.is_null() || type.empty()) {
-                return j;
+            auto tit = j.find("type");
+            if (tit == j.end() || ! tit->is_string() || tit->get_ref<const std::string&>().empty()) {
+                if (tit != j.end() && ! tit->is_null() && ! tit->is_string()) {
+                    err = "type should be a string!";
+                    return false;
+                }
+                out = j;
+                return true;
             }
 
-            type = trim_type(type.get<std::string>());
+            std::string type = trim_type(tit->get<std::string>());
+            json value = j["value"];
 
-            auto value = j["value"];
             if (type == TYPE_BOOL) {
-                return value.get<bool>();
+                return json_get<bool>(value, out, err, type);
             }
             if (type == TYPE_CHAR) {
-                return value.get<char>();
+                return json_get<char>(value, out, err, type);
             }
             if (type == TYPE_BYTE) {
-                return value.get<std::byte>();
+                return json_get<std::byte>(value, out, err, type);
             }
             if (type == TYPE_SHORT) {
-                return value.get<short>();
+                return json_get<short>(value, out, err, type);
             }
             if (type == TYPE_INT) {
-                return value.get<int>();
+                return json_get<int>(value, out, err, type);
             }
             if (type == TYPE_LONG) {
-                return value.get<long>();
+                return json_get<long>(value, out, err, type);
             }
             if (type == TYPE_LONG_LONG) {
-                return value.get<long long>();
+                return json_get<long long>(value, out, err, type);
             }
             if (type == TYPE_FLOAT) {
-                return value.get<float>();
+                return json_get<float>(value, out, err, type);
             }
             if (type == TYPE_DOUBLE) {
-                return value.get<double>();
+                return json_get<double>(value, out, err, type);
             }
             if (type == TYPE_STRING) {
-                return value.get<std::string>();
+                return json_get<std::string>(value, out, err, type);
             }
-            // if (type == "any" || type == "std::any") {
-            //     return j;
-            // }
 
-            std::string type_s = type;
-            int l = type_s.size();
-            if (l > 2 && type_s.substr( l - 2, l) == "[]") {
-                if (type == TYPE_BOOL_ARR) {
-                    auto vec = value.get<std::vector<bool>>();
-                    bool arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-
-                    return *arr;
-                }
-
-                if (type == TYPE_CHAR_ARR) {
-                    auto vec = value.get<std::vector<char>>();
-                    char arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_BYTE_ARR) {
-                    auto vec = value.get<std::vector<std::byte>>();
-                    std::byte arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_SHORT_ARR) {
-                    auto vec = value.get<std::vector<short>>();
-                    short arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_INT_ARR) {
-                    auto vec = value.get<std::vector<int>>();
-                    int arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_LONG_ARR) {
-                    auto vec = value.get<std::vector<long>>();
-                    long arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_LONG_LONG_ARR) {
-                    auto vec = value.get<std::vector<long long>>();
-                    long long arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_FLOAT_ARR) {
-                    auto vec = value.get<std::vector<float>>();
-                    float arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_DOUBLE_ARR) {
-                    auto vec = value.get<std::vector<double>>();
-                    double arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
-
-                if (type == TYPE_STRING_ARR) {
-                    auto vec = value.get<std::vector<std::string>>();
-                    std::string arr[vec.size()];
-                    for (int i = 0; i < vec.size(); ++i) {
-                        arr[i] = vec.at(i);
-                    }
-                    return *arr;
-                }
+            if (type == TYPE_BOOL_ARR) {
+                return json_get_first<bool>(value, out, err, type);
+            }
+            if (type == TYPE_CHAR_ARR) {
+                return json_get_first<char>(value, out, err, type);
+            }
+            if (type == TYPE_BYTE_ARR) {
+                return json_get_first<std::byte>(value, out, err, type);
+            }
+            if (type == TYPE_SHORT_ARR) {
+                return json_get_first<short>(value, out, err, type);
+            }
+            if (type == TYPE_INT_ARR) {
+                return json_get_first<int>(value, out, err, type);
+            }
+            if (type == TYPE_LONG_ARR) {
+                return json_get_first<long>(value, out, err, type);
+            }
+            if (type == TYPE_LONG_LONG_ARR) {
+                return json_get_first<long long>(value, out, err, type);
+            }
+            if (type == TYPE_FLOAT_ARR) {
+                return json_get_first<float>(value, out, err, type);
+            }
+            if (type == TYPE_DOUBLE_ARR) {
+                return json_get_first<double>(value, out, err, type);
+            }
+            if (type == TYPE_STRING_ARR) {
+                return json_get_first<std::string>(value, out, err, type);
             }
-            else if (l > strlen("vector<")) { // && type_s.substr(0, strlen("vector<")) == "vector<") { // && type_s.find('<') < type_s.find_last_of('>')) {
-                if (type == "vector<bool>") {
-                    auto vec = value.get<std::vector<bool>>();
-                    return vec;
-                }
-
-                if (type == "vector<char>") {
-                    auto vec = value.get<std::vector<char>>();
-                    return vec;
-                }
-
-                if (type == "vector<byte>") {
-                    auto vec = value.get<std::vector<std::byte>>();
-                    return vec;
-                }
-
-                if (type == "vector<short>") {
-                    auto vec = value.get<std::vector<short>>();
-                    return vec;
-                }
-
-                if (type == "vector<int>") {
-                    auto vec = value.get<std::vector<int>>();
-                    return vec;
-                }
-
-                if (type == "vector<long>") {
-                    auto vec = value.get<std::vector<long>>();
-                    return vec;
-                }
-
-                if (type == "vector<long long>") {
-                    auto vec = value.get<std::vector<long long>>();
-                    return vec;
-                }
-
-                if (type == "vector<float>") {
-                    auto vec = value.get<std::vector<float>>();
-                    return vec;
-                }
-
-                if (type == "vector<double>") {
-                    auto vec = value.get<std::vector<double>>();
-                    return vec;
-                }
 
-                if (type_s == "vector<string>") {
-                    auto vec = value.get<std::vector<std::string>>();
-                    return vec;
-                }
+            if (type == "vector<bool>") {
+                return json_get<std::vector<bool>>(value, out, err, type);
+            }
+            if (type == "vector<char>") {
+                return json_get<std::vector<char>>(value, out, err, type);
+            }
+            if (type == "vector<byte>") {
+                return json_get<std::vector<std::byte>>(value, out, err, type);
+            }
+            if (type == "vector<short>") {
+                return json_get<std::vector<short>>(value, out, err, type);
+            }
+            if (type == "vector<int>") {
+                return json_get<std::vector<int>>(value, out, err, type);
+            }
+            if (type == "vector<long>") {
+                return json_get<std::vector<long>>(value, out, err, type);
+            }
+            if (type == "vector<long long>") {
+                return json_get<std::vector<long long>>(value, out, err, type);
+            }
+            if (type == "vector<float>") {
+                return json_get<std::vector<float>>(value, out, err, type);
+            }
+            if (type == "vector<double>") {
+                return json_get<std::vector<double>>(value, out, err, type);
+            }
+            if (type == "vector<string>") {
+                return json_get<std::vector<std::string>>(value, out, err, type);
             }
 
-            try {
-                return json_2_obj<std::any>(value, type);
-            } catch (const std::exception& e) {
-                printlnErr(get_type(e), ": ", e.what());
-                return json_2_any(value, type);
+            if (try_json_2_any(value, type, out)) {
+                return true;
             }
+            err = "Unknown type: " + type + ", call add_type/add_class/add_struct/add_ptr/add_val firstly!";
+            return false;
         }
 
         if (j.is_array()) {
             std::vector<std::any> vec;
-            for (int i = 0; i < j.size(); ++i) {
-                auto arg = j[i];
-                vec.push_back(json_to_any(arg));
+            vec.reserve(j.size());
+            for (auto &arg : j) {
+                std::any a;
+                if (! try_json_to_any(arg, a, err)) {
+                    return false;
+                }
+                vec.push_back(std::move(a));
             }
-            return vec;
+            out = std::move(vec);
+            return true;
         }
 
-        return static_cast<std::any>(j);
+        out = j;
+        return true;
+    }
+
+    static std::any json_to_any(json &j) {
+        std::any out;
+        std::string err;
+        if (! try_json_to_any(j, out, err)) {
+            throw std::runtime_error(err);
+        }
+        return out;
     }
 
 
@@ -808,7 +1139,7 @@ namespace unitauto {
         try {
             delete static_cast<T*>(obj);
         } catch (const std::exception& e) {
-            std::cout << e.what() << std::endl;
+            log_error("del_obj: ", e.what());
         }
     }
 
@@ -846,13 +1177,17 @@ namespace unitauto {
             auto p = &obj;
             return static_cast<void*>(p);
         };
-        PTR_MAP["*" + type] = PTR_MAP["&" + type] = PTR_MAP[type + "*"] = PTR_MAP[type + "&"] = cb;
 
-        std::string t = trim_type(demangle(typeid(T).name()));
-        if (t != type) {
-            PTR_MAP["*" + t] = PTR_MAP["&" + t] = PTR_MAP[t + "*"] = PTR_MAP[t + "&"] = cb;
-            TYEP_ALIAS_MAP[t] = type;
-            TYEP_ALIAS_MAP[type] = t;
+        std::string t = type_name<T>();
+        {
+            std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+            PTR_MAP["*" + type] = PTR_MAP["&" + type] = PTR_MAP[type + "*"] = PTR_MAP[type + "&"] = cb;
+
+            if (t != type) {
+                PTR_MAP["*" + t] = PTR_MAP["&" + t] = PTR_MAP[t + "*"] = PTR_MAP[t + "&"] = cb;
+                TYEP_ALIAS_MAP[t] = type;
+                TYEP_ALIAS_MAP[type] = t;
+            }
         }
 
         add_cast<T>(type, caster);
@@ -872,6 +1207,7 @@ namespace unitauto {
 
     // 取消注册类型
     static void remove_ptr(const std::string& type) {
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
         PTR_MAP.erase(type);
     }
 
@@ -879,12 +1215,14 @@ namespace unitauto {
     template<typename T>
     static void add_val(const std::string& type, T callback(json& j), json caster(std::any val)) {
         // typeid(T).name() 会得到 4User 这种带了其它字符的名称
+        std::string t = type_name<T>();
+
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
         VAL_MAP[type] = [callback](json &j) -> std::any {
             auto obj = callback != nullptr ? callback(j) : INSTANCE_GETTER<T>(j);
             return std::any_cast<T>(obj);
         };
 
-        std::string t = trim_type(demangle(typeid(T).name()));
         if (t != type) {
             VAL_MAP[t] = VAL_MAP[type];
             TYEP_ALIAS_MAP[t] = type;
@@ -906,6 +1244,7 @@ namespace unitauto {
 
     // 取消注册类型
     static void remove_val(const std::string& type) {
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
         VAL_MAP.erase(type);
     }
 
@@ -985,822 +1324,3701 @@ namespace unitauto {
         remove_val(type);
     }
 
-    // 函数与方法(成员函数) <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
-
-    using FT = std::function<std::any(json &j, std::vector<std::any>)>;
-    static std::map<std::string, FT> FUNC_MAP;
+    // 延迟直方图，桶上界单位为微秒，只用原子操作，可以在多个工作线程中同时记录
+    class Histogram {
+    public:
+        static constexpr size_t BUCKET_COUNT = 16;
+        static constexpr long long BUCKETS[BUCKET_COUNT] = {
+            50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+            100000, 250000, 500000, 1000000, 2500000, 10000000
+        };
 
-    // 执行已注册的函数/方法(成员函数)
-    static std::any invoke(const std::string &name, std::vector<std::any> args) {
-        auto it = FUNC_MAP.find(name);
-        if (it != FUNC_MAP.end()) {
-            json j;
-            return it->second(j, args);
+        void observe(long long micros) {
+            size_t i = 0;
+            while (i < BUCKET_COUNT && micros > BUCKETS[i]) {
+                ++i;
+            }
+            counts_[i].fetch_add(1, std::memory_order_relaxed); // i == BUCKET_COUNT 为 +Inf
+            sum_.fetch_add(micros < 0 ? 0 : static_cast<uint64_t>(micros), std::memory_order_relaxed);
         }
-        throw std::runtime_error("Unkown func: " + name + ", call add_func firstly!");
-    }
 
-    // 执行已注册的函数/方法(成员函数)
-    static std::any invoke_method(json &thiz, const std::string &func, std::vector<std::any> args) {
-        json type = thiz["type"];
-        json value = thiz["value"];
-
-        if (! type.empty()) {
-            std::string t = trim_type(type.get<std::string>());
-            auto it = PTR_MAP.find(t);
-            if (it != PTR_MAP.end()) {
-                it->second(value);
-            } else {
-                auto it2 = VAL_MAP.find(t);
-                if (it2 != VAL_MAP.end()) {
-                    it2->second(value);
+        // 按 Prometheus 文本格式输出 name_bucket/name_sum/name_count，labels 形如 route="/method/list"
+        void write(std::ostream& out, const std::string& name, const std::string& labels) const {
+            std::string prefix = labels.empty() ? "" : labels + ",";
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i <= BUCKET_COUNT; ++i) {
+                cumulative += counts_[i].load(std::memory_order_relaxed);
+                out << name << "_bucket{" << prefix << "le=\"";
+                if (i < BUCKET_COUNT) {
+                    out << BUCKETS[i] / 1e6;
+                } else {
+                    out << "+Inf";
                 }
+                out << "\"} " << cumulative << "\n";
             }
-        }
 
-        auto it = FUNC_MAP.find(func);
-        if (it != FUNC_MAP.end()) {
-            return it->second(thiz, args);
+            std::string braces = labels.empty() ? "" : "{" + labels + "}";
+            out << name << "_sum" << braces << " " << sum_.load(std::memory_order_relaxed) / 1e6 << "\n";
+            out << name << "_count" << braces << " " << cumulative << "\n";
         }
 
-        throw std::runtime_error("Unkown func: " + func + ", call add_func/add_const_func firstly!");
-    }
+    private:
+        std::atomic<uint64_t> counts_[BUCKET_COUNT + 1] = {};
+        std::atomic<uint64_t> sum_{0};
+    };
 
-    // 执行非 void 函数
-    template<typename Ret, typename... Args, std::size_t... I>
-    static std::any invoke(std::function<Ret(Args...)> func, std::vector<std::any> &args, std::index_sequence<I...>) {
-        return func(std::any_cast<Args>(args[I])...);
-    }
+    // 一个路由或一个函数的调用统计
+    struct CallMetrics {
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> errors{0};
+        Histogram latency;
 
-    // 执行 void 函数
-    template<typename... Args, std::size_t... I>
-    static void invoke_void(std::function<void(Args...)> func, std::vector<std::any> &args, std::index_sequence<I...>) {
-        func(std::any_cast<Args>(args[I])...);
-    }
+        void observe(long long micros, bool failed) {
+            total.fetch_add(1, std::memory_order_relaxed);
+            if (failed) {
+                errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            latency.observe(micros);
+        }
+    };
 
-    // 执行非 void 方法(成员函数)，针对 class 等的指针方式
-    template<typename Ret, typename T, typename... Args, std::size_t... I>
-    static std::any invoke(T *instance, Ret (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
-        return (instance->*func)(std::any_cast<Args>(args[I])...);
-    }
+    // TYPE_CAST_MAP 中的内置类型，转 JSON 时可以直接 json(v)，结果与 builtin_to_json 一致
+    template<typename T, typename... Ts>
+    struct is_one_of : std::disjunction<std::is_same<T, Ts>...> {};
 
-    // 执行 void 方法(成员函数)
-    template<typename T, typename... Args, std::size_t... I>
-    static void invoke_void(T *instance, void (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
-        (instance->*func)(std::any_cast<Args>(args[I])...);
-    }
+    template<typename T>
+    struct is_builtin_json : is_one_of<T, bool, std::byte, char, short, int, long, long long, float, double, std::string> {};
 
-    // 执行非 void 方法(成员函数)，针对 struct 等的值类型方式
-    template<typename Ret, typename T, typename... Args, std::size_t... I>
-    static std::any invoke_struct(T instance, Ret (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
-        return (instance.*func)(std::any_cast<Args>(args[I])...);
-    }
+    template<typename T>
+    struct is_builtin_json<std::vector<T>> : is_builtin_json<T> {};
 
-    // 执行 void 方法(成员函数)
-    template<typename T, typename... Args, std::size_t... I>
-    static void invoke_struct_void(T instance, void (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
-        (instance.*func)(std::any_cast<Args>(args[I])...);
-    }
+    template<typename T>
+    struct is_builtin_json<std::map<std::string, T>> : is_builtin_json<T> {};
 
-    // 执行非 void 方法(成员函数)，针对 struct 等的值类型方式
-    template<typename Ret, typename T, typename... Args, std::size_t... I>
-    static std::any invoke_const(T instance, Ret (T::*func)(Args...) const, std::vector<std::any> &args, std::index_sequence<I...>) {
-        return (instance.*func)(std::any_cast<Args>(args[I])...);
-    }
+    // 调用路径上的返回值，代替 std::any：放得下内联缓冲区且可无异常移动的类型不分配堆内存，
+    // 例如 std::string, std::vector 及小的 struct。只能移动，内置类型直接转 JSON，其它类型转 JSON 时才装进 std::any
+    class Value {
+    public:
+        static constexpr size_t INLINE_SIZE = 64;
 
-    // 执行 void 方法(成员函数)
-    template<typename T, typename... Args, std::size_t... I>
-    static void invoke_const_void(T instance, void (T::*func)(Args...) const, std::vector<std::any> &args, std::index_sequence<I...>) {
-        (instance.*func)(std::any_cast<Args>(args[I])...);
-    }
+        Value() noexcept = default;
 
-    // 注册函数
-    template<typename Ret, typename... Args>
-    static void add_func(const std::string &name, std::function<Ret(Args...)> func) {
-        FUNC_MAP[name] = [func](json &j, std::vector<std::any> args) -> std::any {
-            if constexpr (std::is_void_v<Ret>) {
-                invoke_void(func, args, std::index_sequence_for<Args...>{});
-                return nullptr;
+        template<typename V, typename T = std::decay_t<V>, typename = std::enable_if_t<! std::is_same_v<T, Value>>>
+        Value(V &&v) {
+            if constexpr (is_inline<T>) {
+                new (buf_) T(std::forward<V>(v));
             } else {
-                return invoke(func, args, std::index_sequence_for<Args...>{});
+                *reinterpret_cast<T**>(buf_) = new T(std::forward<V>(v));
             }
-        };
-    }
+            ops_ = &OPS<T>;
+        }
 
-    // 注册方法(成员函数)，针对 class 等的指针方式
-    template<typename Ret, typename T, typename... Args>
-    static void add_func(const std::string &name, T *instance, Ret (T::*func)(Args...)) {
-        FUNC_MAP["&" + name] = [&instance, func](json &j, std::vector<std::any> args) -> std::any {
-            std::string type = j["type"];
-            json value = j["value"];
-            if (instance == nullptr || ! value.empty()) {
-                auto ins = INSTANCE_GETTER<T>(value); // static_cast<T>(ins);
-                instance = &ins;
-            }
+        Value(Value &&other) noexcept {
+            take(other);
+        }
 
-            std::any ret = nullptr;
-            if constexpr (std::is_void_v<Ret>) {
-                invoke_void(instance, func, args, std::index_sequence_for<Args...>{});
-            } else {
-                ret = invoke(instance, func, args, std::index_sequence_for<Args...>{});
+        Value& operator=(Value &&other) noexcept {
+            if (this != &other) {
+                reset();
+                take(other);
             }
+            return *this;
+        }
 
-            if (! j.empty()) {
-                json v = any_to_json(instance, type);
-                std::string t = get_type(instance);
-                if (! t.empty()) {
-                    j["type"] = t;
-                    if (v.empty()) {
-                        v = any_to_json(instance, type);
-                    }
-                }
+        Value(const Value&) = delete;
+        Value& operator=(const Value&) = delete;
 
-                if (! v.empty()) {
-                    j["value"] = v;
-                }
+        ~Value() {
+            reset();
+        }
+
+        bool has_value() const noexcept {
+            return ops_ != nullptr;
+        }
+
+        const std::type_info& type() const noexcept {
+            return ops_ == nullptr ? typeid(void) : ops_->type(buf_);
+        }
+
+        template<typename T>
+        T* get() noexcept {
+            return ops_ == &OPS<T> ? static_cast<T*>(ops_->ptr(buf_)) : nullptr;
+        }
+
+        // 移出到 std::any，供 invoke 等对外接口及非内置类型的序列化使用
+        std::any to_any() && {
+            if (ops_ == nullptr) {
+                return {};
             }
+            std::any a = ops_->to_any(buf_);
+            reset();
+            return a;
+        }
 
-            return ret;
+        json to_json(const std::string &type) && {
+            if (ops_ != nullptr && ops_->to_json != nullptr) {
+                return ops_->to_json(buf_);
+            }
+            return any_to_json(std::move(*this).to_any(), type);
+        }
+
+        // 是否为 std::vector，可以逐个元素转 JSON 流式输出
+        bool is_sequence() const noexcept {
+            return ops_ != nullptr && ops_->each != nullptr;
+        }
+
+        // 按顺序把每个元素转成 JSON 交给 f，f 返回 false 时停止，返回是否遍历完
+        bool each(const std::function<bool(const json&)> &f) const {
+            return ops_->each(buf_, f);
+        }
+
+    private:
+        struct Ops {
+            const std::type_info& (*type)(const void *buf);
+            void* (*ptr)(const void *buf);
+            void (*move)(void *dst, void *src) noexcept; // 移动到 dst 并析构 src
+            void (*destroy)(void *buf) noexcept;
+            std::any (*to_any)(void *buf);
+            json (*to_json)(const void *buf);
+            bool (*each)(const void *buf, const std::function<bool(const json&)> &f);
         };
-    }
 
-    // 注册方法(成员函数)，针对 struct 等的值类型方式
-    template<typename Ret, typename T, typename... Args>
-    static void add_func(const std::string &name, T instance, Ret (T::*func)(Args...)) {
-        FUNC_MAP[name] = [instance, func](json &j, std::vector<std::any> args) -> std::any {
-            // if (! j.empty()) {
-            //     j.get_to(instance);
-            // }
+        template<typename T>
+        struct is_vector : std::false_type {};
+
+        template<typename E, typename A>
+        struct is_vector<std::vector<E, A>> : std::true_type {};
+
+        // 元素是内置类型时直接 json(e)，否则复制进 std::any 按注册的转换函数转换，每次只转一个元素
+        template<typename T>
+        static bool each_json(const void *buf, const std::function<bool(const json&)> &f) {
+            if constexpr (is_vector<T>::value) {
+                using E = typename T::value_type;
+                for (const auto &e : *ptr_of<T>(buf)) {
+                    json j;
+                    if constexpr (is_builtin_json<E>::value) {
+                        j = static_cast<E>(e);
+                    } else {
+                        j = any_to_json(std::any(static_cast<E>(e)), unitauto::type_name<E>());
+                    }
+                    if (! f(j)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
 
-            if constexpr (std::is_void_v<Ret>) {
-                invoke_struct_void(instance, func, args, std::index_sequence_for<Args...>{});
-                return nullptr;
+        template<typename T>
+        static constexpr bool is_streamable() {
+            if constexpr (is_vector<T>::value) {
+                return std::is_copy_constructible_v<typename T::value_type>;
             } else {
-                return invoke_struct(instance, func, args, std::index_sequence_for<Args...>{});
+                return false;
             }
-        };
-
-        // add_func(name, &instance, func);
-    }
+        }
 
+        template<typename T>
+        static constexpr bool is_inline = sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<T>;
 
-    // 注册方法(成员函数)，针对 struct 等的值类型方式
-    template<typename Ret, typename T, typename... Args>
-    static void add_const_func(const std::string &name, T instance, Ret (T::*func)(Args...) const) {
-        FUNC_MAP[name] = [instance, func](json &j, std::vector<std::any> args) -> std::any {
-            // if (! j.empty()) {
-            //     j.get_to(instance);
-            // }
+        template<typename T>
+        static T* ptr_of(const void *buf) {
+            if constexpr (is_inline<T>) {
+                return const_cast<T*>(static_cast<const T*>(buf));
+            } else {
+                return *static_cast<T* const*>(buf);
+            }
+        }
 
-            if constexpr (std::is_void_v<Ret>) {
-                invoke_const_void(instance, func, args, std::index_sequence_for<Args...>{});
-                return nullptr;
+        template<typename T>
+        static json builtin_json(const void *buf) {
+            if constexpr (is_builtin_json<T>::value) {
+                return *ptr_of<T>(buf);
             } else {
-                return invoke_const(instance, func, args, std::index_sequence_for<Args...>{});
+                return nullptr;
             }
+        }
+
+        template<typename T>
+        static inline const Ops OPS = {
+            [](const void *buf) -> const std::type_info& {
+                if constexpr (std::is_same_v<T, std::any>) {
+                    return ptr_of<T>(buf)->type();
+                } else {
+                    return typeid(T);
+                }
+            },
+            [](const void *buf) -> void* {
+                return ptr_of<T>(buf);
+            },
+            [](void *dst, void *src) noexcept {
+                if constexpr (is_inline<T>) {
+                    T *p = ptr_of<T>(src);
+                    new (dst) T(std::move(*p));
+                    p->~T();
+                } else {
+                    *static_cast<T**>(dst) = ptr_of<T>(src);
+                }
+            },
+            [](void *buf) noexcept {
+                if constexpr (is_inline<T>) {
+                    ptr_of<T>(buf)->~T();
+                } else {
+                    delete ptr_of<T>(buf);
+                }
+            },
+            [](void *buf) -> std::any {
+                return std::any(std::move(*ptr_of<T>(buf)));
+            },
+            is_builtin_json<T>::value ? &builtin_json<T> : nullptr,
+            is_streamable<T>() ? &each_json<T> : nullptr
         };
 
-        // add_func(name, &instance, func);
-    }
+        void take(Value &other) noexcept {
+            if (other.ops_ != nullptr) {
+                other.ops_->move(buf_, other.buf_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
 
-    // 函数与方法(成员函数) >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+        void reset() noexcept {
+            if (ops_ != nullptr) {
+                ops_->destroy(buf_);
+                ops_ = nullptr;
+            }
+        }
 
-    static std::map<std::string, void*> INSTANCE_MAP; // = {
-    //     {TYPE_BOOL, false},
-    //     {TYPE_CHAR, ''},
-    //     {TYPE_SHORT, static_cast<short>(1)},
-    //     {TYPE_INT, 1},
-    //     {TYPE_LONG, 0L},
-    //     {TYPE_LONG, 0L},
-    //     {TYPE_LONG, 0L},
-    //     {TYPE_LONG, 0L}
-    // };
-    // INSTANCE_MAP[TYPE_BOOL] = false;
+        alignas(std::max_align_t) unsigned char buf_[INLINE_SIZE];
+        const Ops *ops_ = nullptr;
+    };
 
-    static void init() {
-        // PTR_MAP[TYPE_INT] = typeid(0);
+    // 函数与方法(成员函数) <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
-    }
+    // 参数按引用传入，执行时移动到目标函数的形参，避免每次调用复制所有 std::any
+    using FT = std::function<Value(json &j, std::vector<std::any> &args)>;
 
+    // 准备好的一次调用：实参已转换好，指针方式的实例已按 this 构建好。
+    // call 只执行目标函数，finish 不为空时在 call 之后把实例写回 this
+    struct BoundCall {
+        std::function<Value()> call;
+        std::function<void()> finish;
 
-    template <typename Func>
-    struct function_traits;
+        Value operator()() {
+            Value ret = call();
+            if (finish) {
+                finish();
+            }
+            return ret;
+        }
+    };
 
-    template <typename Ret, typename... Args>
-    struct function_traits<std::function<Ret(Args...)>> {
-        using return_type = Ret;
-        using argument_types = std::tuple<Args...>;
+    // FT 的准备阶段，invoke_json 在计时区外执行，实参按引用绑定，call 时才移动到形参
+    using BFT = std::function<BoundCall(json &j, std::vector<std::any> &args)>;
+    // add_func 按形参类型生成的准备函数，实参直接从 JSON 数组解码成形参类型，不经过 std::any；
+    // method_args 不为空时写入解码后的实参
+    using JFT = std::function<BoundCall(json &j, const json &args, json *method_args)>;
+
+    struct FuncEntry {
+        std::string name;
+        BFT bind;
+        JFT jfunc; // 有形参不能从 JSON 直接解码(例如指针)时为空
+        std::shared_ptr<CallMetrics> metrics = std::make_shared<CallMetrics>(); // 通过 invoke_json 调用的统计，/metrics 输出
     };
 
-    static nlohmann::json new_ok_result() {
-        nlohmann::json result;
-        result["language"] = "C++";
-        result["code"] = 200;
-        result["msg"] = "success";
-        return result;
-    }
+    // 查找到的函数副本，供 invoke_json 在锁外执行
+    struct FuncRef {
+        BFT bind;
+        JFT jfunc;
+        std::shared_ptr<CallMetrics> metrics;
+    };
 
-    static nlohmann::json new_err_result(int code, std::string msg) {
-        nlohmann::json result;
-        result["language"] = "C++";
-        result["code"] = code;
-        result["msg"] = msg;
-        return result;
+    // 函数路径的 FNV-1a 哈希，可以分段累加，按 package, class, method 查找时不用拼接出完整路径
+    static constexpr size_t FUNC_HASH_BASIS = sizeof(size_t) == 8 ? 14695981039346656037ULL : 2166136261U;
+    static constexpr size_t FUNC_HASH_PRIME = sizeof(size_t) == 8 ? 1099511628211ULL : 16777619U;
+
+    static size_t func_hash(std::string_view s, size_t h = FUNC_HASH_BASIS) {
+        for (unsigned char c : s) {
+            h = (h ^ c) * FUNC_HASH_PRIME;
+        }
+        return h;
     }
 
-    template <typename E>
-    static nlohmann::json new_err_result(E& e) {
+    // 路径各段，空的 package, class 不参与拼接，和 invoke_json 中 package.class.method 的规则一致
+    struct FuncPath {
+        std::string_view pkg;
+        std::string_view cls;
+        std::string_view mtd;
+
+        size_t hash() const {
+            size_t h = FUNC_HASH_BASIS;
+            if (! pkg.empty()) {
+                h = func_hash(".", func_hash(pkg, h));
+            }
+            if (! cls.empty()) {
+                h = func_hash(".", func_hash(cls, h));
+            }
+            return func_hash(mtd, h);
+        }
+
+        bool equals(std::string_view name) const {
+            size_t size = mtd.size() + (pkg.empty() ? 0 : pkg.size() + 1) + (cls.empty() ? 0 : cls.size() + 1);
+            if (name.size() != size) {
+                return false;
+            }
+
+            for (auto part : {pkg, cls}) {
+                if (part.empty()) {
+                    continue;
+                }
+                if (name.compare(0, part.size(), part) != 0 || name[part.size()] != '.') {
+                    return false;
+                }
+                name.remove_prefix(part.size() + 1);
+            }
+            return name == mtd;
+        }
+
+        char front() const {
+            return ! pkg.empty() ? pkg.front() : (! cls.empty() ? cls.front() : (mtd.empty() ? '\0' : mtd.front()));
+        }
+
+        std::string str() const {
+            std::string s;
+            s.reserve(pkg.size() + cls.size() + mtd.size() + 2);
+            if (! pkg.empty()) {
+                s.append(pkg).append(".");
+            }
+            if (! cls.empty()) {
+                s.append(cls).append(".");
+            }
+            return s.append(mtd);
+        }
+    };
+
+    // 完整路径哈希 -> 函数，同一哈希下按完整路径逐段比较
+    static std::unordered_multimap<size_t, FuncEntry> FUNC_MAP;
+
+    // 需持有 REGISTRY_MUTEX
+    static const FuncEntry* find_func_entry(const FuncPath &path) {
+        auto range = FUNC_MAP.equal_range(path.hash());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (path.equals(it->second.name)) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    // 查找已注册的函数/方法(成员函数)，返回副本，找不到时返回空的 FT
+    static FT find_func(const FuncPath &path) {
+        std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        auto e = find_func_entry(path);
+        if (e == nullptr) {
+            return FT();
+        }
+        return [bind = e->bind](json &j, std::vector<std::any> &args) -> Value {
+            return bind(j, args)();
+        };
+    }
+
+    static FT find_func(std::string_view name) {
+        return find_func(FuncPath{{}, {}, name});
+    }
+
+    // 执行已注册的函数/方法(成员函数)
+    static std::any invoke(const std::string &name, std::vector<std::any> args) {
+        auto f = find_func(name);
+        if (f) {
+            json j;
+            return f(j, args).to_any();
+        }
+        throw std::runtime_error("Unkown func: " + name + ", call add_func firstly!");
+    }
+
+    // 执行已注册的函数/方法(成员函数)
+    // 按 this 的类型预先执行已注册的实例获取函数
+    static void prepare_this(json &thiz) {
+        json type = thiz["type"];
+        json value = thiz["value"];
+
+        if (! type.empty()) {
+            std::string t = trim_type(type.get<std::string>());
+            std::function<void*(json &j)> ptr_getter;
+            std::function<std::any(json &j)> val_getter;
+            {
+                std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+                auto it = PTR_MAP.find(t);
+                if (it != PTR_MAP.end()) {
+                    ptr_getter = it->second;
+                } else {
+                    auto it2 = VAL_MAP.find(t);
+                    if (it2 != VAL_MAP.end()) {
+                        val_getter = it2->second;
+                    }
+                }
+            }
+
+            if (ptr_getter) {
+                ptr_getter(value);
+            } else if (val_getter) {
+                val_getter(value);
+            }
+        }
+    }
+
+    // 查找要执行的函数/方法(成员函数)，找不到时抛出异常
+    static FuncRef find_method(const FuncPath &path) {
+        {
+            std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+            auto e = find_func_entry(path);
+            if (e != nullptr) {
+                return FuncRef{e->bind, e->jfunc, e->metrics};
+            }
+        }
+        throw std::runtime_error("Unkown func: " + path.str() + ", call add_func/add_const_func firstly!");
+    }
+
+    static std::any invoke_method(json &thiz, const FuncPath &path, std::vector<std::any> &args) {
+        prepare_this(thiz);
+        return find_method(path).bind(thiz, args)().to_any();
+    }
+
+    static std::any invoke_method(json &thiz, const std::string &func, std::vector<std::any> args) {
+        return invoke_method(thiz, FuncPath{{}, {}, func}, args);
+    }
+
+    // 方法目录中的一个方法，注册时记录真实的返回值与参数类型
+    struct MethodInfo {
+        std::string name;
+        std::string returnType;
+        std::vector<std::string> parameterTypeList;
+        bool is_static = true;
+    };
+
+    template<typename Ret, typename... Args>
+    static MethodInfo method_info(bool is_static) {
+        return MethodInfo{"", type_name<Ret>(), {type_name<std::decay_t<Args>>()...}, is_static};
+    }
+
+    // 方法目录 package -> class -> 完整路径 -> 方法，随 put_func/remove_func 增量维护，需持有 REGISTRY_MUTEX
+    static std::map<std::string, std::map<std::string, std::map<std::string, MethodInfo>>> CATALOG;
+    // 目录每次变更加 1，用于判断缓存的 /method/list 响应是否过期
+    static uint64_t CATALOG_VERSION = 0;
+
+    // 按路径拆分出包名、类名、方法名：最后一段是方法名，倒数第二段首字母大写时是类名，其余是包名
+    static void split_func_path(std::string_view name, std::string &pkg, std::string &cls, std::string &mtd) {
+        auto ind = name.find_last_of('.');
+        if (ind == std::string_view::npos) {
+            pkg.clear();
+            cls.clear();
+            mtd = name;
+            return;
+        }
+
+        mtd = name.substr(ind + 1);
+        name = name.substr(0, ind);
+
+        ind = name.find_last_of('.');
+        std::string_view last = ind == std::string_view::npos ? name : name.substr(ind + 1);
+        if (! last.empty() && last.front() >= 'A' && last.front() <= 'Z') {
+            cls = last;
+            name = ind == std::string_view::npos ? std::string_view() : name.substr(0, ind);
+        } else {
+            cls.clear();
+        }
+        pkg = name;
+    }
+
+    // 写入已注册的函数/方法(成员函数)，bind 与 jfunc 见 BFT 与 JFT
+    static void put_bound_func(const std::string &name, BFT bind, MethodInfo info = {}, JFT jfunc = nullptr) {
+        FuncPath path{{}, {}, name};
+        std::string pkg, cls, mtd;
+        split_func_path(name, pkg, cls, mtd);
+        info.name = mtd;
+
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        auto e = const_cast<FuncEntry*>(find_func_entry(path));
+        if (e != nullptr) {
+            e->bind = std::move(bind);
+            e->jfunc = std::move(jfunc);
+        } else {
+            FUNC_MAP.emplace(path.hash(), FuncEntry{name, std::move(bind), std::move(jfunc)});
+        }
+
+        CATALOG[pkg][cls][name] = std::move(info);
+        CATALOG_VERSION ++;
+    }
+
+    // 写入已注册的函数/方法(成员函数)，func 整体计时
+    static void put_func(const std::string &name, FT func, MethodInfo info = {}, JFT jfunc = nullptr) {
+        put_bound_func(name, [func](json &j, std::vector<std::any> &args) -> BoundCall {
+            return BoundCall{[func, &j, &args]() -> Value {
+                return func(j, args);
+            }, nullptr};
+        }, std::move(info), std::move(jfunc));
+    }
+
+    // 移除已注册的函数/方法(成员函数)
+    static void remove_func(const std::string &name) {
+        FuncPath path{{}, {}, name};
+        std::string pkg, cls, mtd;
+        split_func_path(name, pkg, cls, mtd);
+
+        std::unique_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        auto range = FUNC_MAP.equal_range(path.hash());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.name == name) {
+                FUNC_MAP.erase(it);
+                break;
+            }
+        }
+
+        auto pit = CATALOG.find(pkg);
+        if (pit == CATALOG.end()) {
+            return;
+        }
+        auto cit = pit->second.find(cls);
+        if (cit == pit->second.end() || cit->second.erase(name) <= 0) {
+            return;
+        }
+
+        if (cit->second.empty()) {
+            pit->second.erase(cit);
+        }
+        if (pit->second.empty()) {
+            CATALOG.erase(pit);
+        }
+        CATALOG_VERSION ++;
+    }
+
+    // 取出第 i 个实参：值类型形参直接从 std::any 中移动出来，引用类型形参绑定到 std::any 中的值
+    template<typename T>
+    static T arg_cast(std::any &arg) {
+        if constexpr (std::is_reference_v<T>) {
+            return std::any_cast<T>(arg);
+        } else {
+            return std::any_cast<T>(std::move(arg));
+        }
+    }
+
+    // typed 调用中实参不能解码成形参类型，invoke_json 返回 400
+    struct ArgDecodeError : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // 返回结果 methodArgs 中的一项：转换后实参的类型与值，转换失败时退回原始 JSON
+    static json method_arg_json(const std::any &a, const json &arg) {
+        json ma;
+        std::string t;
+        try {
+            t = get_type(a);
+            if (t.empty()) {
+                t = arg.type_name();
+            }
+            ma["type"] = t;
+        } catch (const std::exception& e) {
+            log_warn("invoke_json get_type(arg) failed: ", e.what(), ", fall back to arg.type_name()");
+            t = arg.type_name();
+            ma["type"] = t;
+        } catch (const nlohmann::json::parse_error& ex) {
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+        } catch (const nlohmann::json::type_error& ex) {
+            log_debug("nlohmann::json::type_error ", ex.what());
+        } catch (const nlohmann::json::other_error& ex) {
+            log_debug("nlohmann::json::other_error ", ex.what());
+        }
+
+        try {
+            ma["value"] = any_to_json(a, ma["type"].get<std::string>());
+        } catch (const std::exception& e) {
+            log_warn("invoke_json any_to_json(arg) failed: ", e.what(), ", fall back to the raw arg");
+            ma["value"] = arg;
+        } catch (const nlohmann::json::parse_error& ex) {
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+        } catch (const nlohmann::json::type_error& ex) {
+            log_debug("nlohmann::json::type_error ", ex.what());
+        } catch (const nlohmann::json::other_error& ex) {
+            log_debug("nlohmann::json::other_error ", ex.what());
+        }
+        return ma;
+    }
+
+    // typed 调用解码出的实参与 std::any 方式格式一致，不能放进 std::any 的类型只返回形参类型与原始 JSON
+    template<typename T>
+    static json decoded_arg_json(const T &value, const json &arg) {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            return method_arg_json(std::any(value), arg);
+        } else {
+            json ma;
+            ma["type"] = type_name<T>();
+            ma["value"] = arg;
+            return ma;
+        }
+    }
+
+    // 形参类型能否用 nlohmann get<T>() 直接从 JSON 解码，指针等不能解码的形参走 std::any 方式
+    template<typename T, typename = void>
+    struct has_json_get : std::false_type {};
+
+    template<typename T>
+    struct has_json_get<T, std::enable_if_t<nlohmann::detail::has_from_json<json, T>::value
+        || nlohmann::detail::has_non_default_from_json<json, T>::value>> : std::true_type {};
+
+    template<typename T>
+    struct is_json_decodable : std::conjunction<std::negation<std::is_pointer<std::decay_t<T>>>, has_json_get<std::decay_t<T>>> {};
+
+    template<typename... Args>
+    static constexpr bool all_json_decodable = (is_json_decodable<Args>::value && ...);
+
+    template<typename T>
+    static std::decay_t<T> decode_arg(const json &args, std::size_t i) {
+        try {
+            return args[i].get<std::decay_t<T>>();
+        } catch (const nlohmann::json::exception &e) {
+            throw ArgDecodeError("args[" + std::to_string(i) + "]: " + e.what());
+        }
+    }
+
+    // 值类型形参移动进去，引用类型形参绑定到解码出的临时值
+    template<typename T, typename V>
+    static decltype(auto) forward_arg(V &v) {
+        if constexpr (std::is_reference_v<T>) {
+            return (v);
+        } else {
+            return std::move(v);
+        }
+    }
+
+    // 实参个数必须和形参一致，否则按下标取实参会越界
+    static void check_arg_count(size_t count, size_t expected) {
+        if (count != expected) {
+            throw ArgDecodeError("args should have " + std::to_string(expected) + " items, but got " + std::to_string(count) + "!");
+        }
+    }
+
+    // 把 JSON 实参按顺序解码成形参类型，method_args 不为空时写入解码后的实参
+    template<typename... Args, std::size_t... I>
+    static std::shared_ptr<std::tuple<std::decay_t<Args>...>> decode_json_args(const json &args, json *method_args, std::index_sequence<I...>) {
+        if (! args.is_array()) {
+            throw ArgDecodeError("args should be an array!");
+        }
+        check_arg_count(args.size(), sizeof...(Args));
+
+        // 花括号初始化保证按顺序解码
+        using Values = std::tuple<std::decay_t<Args>...>;
+        std::shared_ptr<Values> values(new Values{decode_arg<Args>(args, I)...});
+        if (method_args != nullptr) {
+            (method_args->push_back(decoded_arg_json(std::get<I>(*values), args[I])), ...);
+        }
+        return values;
+    }
+
+    // 用解码好的实参执行 call(实参...)，实参只能用一次
+    template<typename Ret, typename... Args, typename Call, std::size_t... I>
+    static Value apply_json_args(std::tuple<std::decay_t<Args>...> &values, Call &call, std::index_sequence<I...>) {
+        if constexpr (std::is_void_v<Ret>) {
+            call(forward_arg<Args>(std::get<I>(values))...);
+            return nullptr;
+        } else {
+            return call(forward_arg<Args>(std::get<I>(values))...);
+        }
+    }
+
+    // 按 Args 在编译期生成 JFT：先把 JSON 实参解码成形参类型，wrap(j, bind_args) 中 bind_args(call)
+    // 返回用解码好的实参执行 call(实参...) 的函数；有形参不能从 JSON 解码时返回空的 JFT，调用时退回 FT
+    template<typename Ret, typename... Args, typename Wrap>
+    static JFT json_func(Wrap wrap) {
+        if constexpr (all_json_decodable<Args...>) {
+            return [wrap](json &j, const json &args, json *method_args) -> BoundCall {
+                auto values = decode_json_args<Args...>(args, method_args, std::index_sequence_for<Args...>{});
+                return wrap(j, [values](auto call) {
+                    return [values, call]() -> Value {
+                        return apply_json_args<Ret, Args...>(*values, call, std::index_sequence_for<Args...>{});
+                    };
+                });
+            };
+        } else {
+            return nullptr;
+        }
+    }
+
+    // 执行非 void 函数
+    template<typename Ret, typename... Args, std::size_t... I>
+    static Value invoke(std::function<Ret(Args...)> func, std::vector<std::any> &args, std::index_sequence<I...>) {
+        return func(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行 void 函数
+    template<typename... Args, std::size_t... I>
+    static void invoke_void(std::function<void(Args...)> func, std::vector<std::any> &args, std::index_sequence<I...>) {
+        func(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行非 void 方法(成员函数)，针对 class 等的指针方式
+    template<typename Ret, typename T, typename... Args, std::size_t... I>
+    static Value invoke(T *instance, Ret (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
+        return (instance->*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行 void 方法(成员函数)
+    template<typename T, typename... Args, std::size_t... I>
+    static void invoke_void(T *instance, void (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
+        (instance->*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行非 void 方法(成员函数)，针对 struct 等的值类型方式，instance 为准备阶段复制好的实例
+    template<typename Ret, typename T, typename... Args, std::size_t... I>
+    static Value invoke_struct(T &instance, Ret (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
+        return (instance.*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行 void 方法(成员函数)
+    template<typename T, typename... Args, std::size_t... I>
+    static void invoke_struct_void(T &instance, void (T::*func)(Args...), std::vector<std::any> &args, std::index_sequence<I...>) {
+        (instance.*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行非 void 方法(成员函数)，针对 struct 等的值类型方式
+    template<typename Ret, typename T, typename... Args, std::size_t... I>
+    static Value invoke_const(const T &instance, Ret (T::*func)(Args...) const, std::vector<std::any> &args, std::index_sequence<I...>) {
+        return (instance.*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 执行 void 方法(成员函数)
+    template<typename T, typename... Args, std::size_t... I>
+    static void invoke_const_void(const T &instance, void (T::*func)(Args...) const, std::vector<std::any> &args, std::index_sequence<I...>) {
+        (instance.*func)(arg_cast<Args>(args[I])...);
+    }
+
+    // 注册函数
+    template<typename Ret, typename... Args>
+    static void add_func(const std::string &name, std::function<Ret(Args...)> func) {
+        put_bound_func(name, [func](json &j, std::vector<std::any> &args) -> BoundCall {
+            check_arg_count(args.size(), sizeof...(Args));
+            return BoundCall{[func, &args]() -> Value {
+                if constexpr (std::is_void_v<Ret>) {
+                    invoke_void(func, args, std::index_sequence_for<Args...>{});
+                    return nullptr;
+                } else {
+                    return invoke(func, args, std::index_sequence_for<Args...>{});
+                }
+            }, nullptr};
+        }, method_info<Ret, Args...>(true), json_func<Ret, Args...>([func](json &j, auto &&bind_args) -> BoundCall {
+            return BoundCall{bind_args([func](auto &&... a) -> Ret {
+                return func(std::forward<decltype(a)>(a)...);
+            }), nullptr};
+        }));
+    }
+
+    // 针对 class 等的指针方式：按 this 的 value 新建实例或使用注册时的实例，make(ptr) 返回只执行方法的函数，
+    // finish 把实例写回 j；实例的构建与写回都在准备阶段及调用之后，不计入调用耗时
+    template<typename T, typename Make>
+    static BoundCall bind_instance(json &j, T *instance, Make &&make) {
+        std::string type = j["type"];
+        json value = j["value"];
+
+        // 按 value 新建的实例需要活到调用和序列化结束
+        auto ins = std::make_shared<std::optional<T>>();
+        T *ptr = instance;
+        if (ptr == nullptr || ! value.empty()) {
+            ins->emplace(INSTANCE_GETTER<T>(value)); // static_cast<T>(ins);
+            ptr = &**ins;
+        }
+
+        BoundCall bound;
+        bound.call = [ins, call = make(ptr)]() -> Value {
+            return call();
+        };
+        bound.finish = [ins, ptr, type, &j]() {
+            if (j.empty()) {
+                return;
+            }
+
+            json v = any_to_json(ptr, type);
+            std::string t = get_type(ptr);
+            if (! t.empty()) {
+                j["type"] = t;
+                if (v.empty()) {
+                    v = any_to_json(ptr, type);
+                }
+            }
+
+            if (! v.empty()) {
+                j["value"] = v;
+            }
+        };
+        return bound;
+    }
+
+    // 注册方法(成员函数)，针对 class 等的指针方式
+    template<typename Ret, typename T, typename... Args>
+    static void add_func(const std::string &name, T *instance, Ret (T::*func)(Args...)) {
+        seed_type_names<T, T*>();
+        put_bound_func("&" + name, [instance, func](json &j, std::vector<std::any> &args) -> BoundCall {
+            check_arg_count(args.size(), sizeof...(Args));
+            return bind_instance(j, instance, [func, &args](T *ptr) {
+                return [ptr, func, &args]() -> Value {
+                    if constexpr (std::is_void_v<Ret>) {
+                        invoke_void(ptr, func, args, std::index_sequence_for<Args...>{});
+                        return nullptr;
+                    } else {
+                        return invoke(ptr, func, args, std::index_sequence_for<Args...>{});
+                    }
+                };
+            });
+        }, method_info<Ret, Args...>(false), json_func<Ret, Args...>([instance, func](json &j, auto &&bind_args) -> BoundCall {
+            return bind_instance(j, instance, [func, &bind_args](T *ptr) {
+                return bind_args([ptr, func](auto &&... a) -> Ret {
+                    return (ptr->*func)(std::forward<decltype(a)>(a)...);
+                });
+            });
+        }));
+    }
+
+    // 注册方法(成员函数)，针对 struct 等的值类型方式，每次调用在准备阶段复制一份实例
+    template<typename Ret, typename T, typename... Args>
+    static void add_func(const std::string &name, T instance, Ret (T::*func)(Args...)) {
+        seed_type_names<T>();
+        put_bound_func(name, [instance, func](json &j, std::vector<std::any> &args) -> BoundCall {
+            check_arg_count(args.size(), sizeof...(Args));
+            // if (! j.empty()) {
+            //     j.get_to(instance);
+            // }
+
+            auto ins = std::make_shared<T>(instance);
+            return BoundCall{[ins, func, &args]() -> Value {
+                if constexpr (std::is_void_v<Ret>) {
+                    invoke_struct_void(*ins, func, args, std::index_sequence_for<Args...>{});
+                    return nullptr;
+                } else {
+                    return invoke_struct(*ins, func, args, std::index_sequence_for<Args...>{});
+                }
+            }, nullptr};
+        }, method_info<Ret, Args...>(false), json_func<Ret, Args...>([instance, func](json &j, auto &&bind_args) -> BoundCall {
+            auto ins = std::make_shared<T>(instance);
+            return BoundCall{bind_args([ins, func](auto &&... a) -> Ret {
+                return ((*ins).*func)(std::forward<decltype(a)>(a)...);
+            }), nullptr};
+        }));
+
+        // add_func(name, &instance, func);
+    }
+
+
+    // 注册方法(成员函数)，针对 struct 等的值类型方式
+    template<typename Ret, typename T, typename... Args>
+    static void add_const_func(const std::string &name, T instance, Ret (T::*func)(Args...) const) {
+        seed_type_names<T>();
+        put_bound_func(name, [instance, func](json &j, std::vector<std::any> &args) -> BoundCall {
+            check_arg_count(args.size(), sizeof...(Args));
+            // if (! j.empty()) {
+            //     j.get_to(instance);
+            // }
+
+            auto ins = std::make_shared<const T>(instance);
+            return BoundCall{[ins, func, &args]() -> Value {
+                if constexpr (std::is_void_v<Ret>) {
+                    invoke_const_void(*ins, func, args, std::index_sequence_for<Args...>{});
+                    return nullptr;
+                } else {
+                    return invoke_const(*ins, func, args, std::index_sequence_for<Args...>{});
+                }
+            }, nullptr};
+        }, method_info<Ret, Args...>(false), json_func<Ret, Args...>([instance, func](json &j, auto &&bind_args) -> BoundCall {
+            auto ins = std::make_shared<const T>(instance);
+            return BoundCall{bind_args([ins, func](auto &&... a) -> Ret {
+                return ((*ins).*func)(std::forward<decltype(a)>(a)...);
+            }), nullptr};
+        }));
+
+        // add_func(name, &instance, func);
+    }
+
+    // 函数与方法(成员函数) >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+
+    static std::map<std::string, void*> INSTANCE_MAP; // = {
+    //     {TYPE_BOOL, false},
+    //     {TYPE_CHAR, ''},
+    //     {TYPE_SHORT, static_cast<short>(1)},
+    //     {TYPE_INT, 1},
+    //     {TYPE_LONG, 0L},
+    //     {TYPE_LONG, 0L},
+    //     {TYPE_LONG, 0L},
+    //     {TYPE_LONG, 0L}
+    // };
+    // INSTANCE_MAP[TYPE_BOOL] = false;
+
+    static void init() {
+        // PTR_MAP[TYPE_INT] = typeid(0);
+
+    }
+
+
+    template <typename Func>
+    struct function_traits;
+
+    template <typename Ret, typename... Args>
+    struct function_traits<std::function<Ret(Args...)>> {
+        using return_type = Ret;
+        using argument_types = std::tuple<Args...>;
+    };
+
+    static nlohmann::json new_ok_result() {
+        nlohmann::json result;
+        result["language"] = "C++";
+        result["code"] = 200;
+        result["msg"] = "success";
+        return result;
+    }
+
+    static nlohmann::json new_err_result(int code, std::string msg) {
+        nlohmann::json result;
+        result["language"] = "C++";
+        result["code"] = code;
+        result["msg"] = msg;
+        return result;
+    }
+
+    template <typename E>
+    static nlohmann::json new_err_result(E& e) {
         nlohmann::json result = new_err_result(500, e.what());
         result["throw"] = get_type(e);
         // result["trace"] = get_type(e);
         return result;
     }
 
-    // static nlohmann::json new_err_result(nlohmann::json::parse_error& e) {
-    //     nlohmann::json result = new_err_result(500, e.what());
-    //     result["throw"] = get_type(e);
-    //     // result["trace"] = get_type(e);
-    //     return result;
-    // }
+    // static nlohmann::json new_err_result(nlohmann::json::parse_error& e) {
+    //     nlohmann::json result = new_err_result(500, e.what());
+    //     result["throw"] = get_type(e);
+    //     // result["trace"] = get_type(e);
+    //     return result;
+    // }
+
+    // 按前缀查找时的上界：去掉末尾的 0xFF 后把最后一个字符加 1，空串表示没有上界
+    static std::string prefix_upper_bound(std::string key) {
+        while (! key.empty() && static_cast<unsigned char>(key.back()) == 0xFF) {
+            key.pop_back();
+        }
+        if (! key.empty()) {
+            key.back() = static_cast<char>(static_cast<unsigned char>(key.back()) + 1);
+        }
+        return key;
+    }
+
+    // 有序 map 中 key 为空时取全部，prefix 为 true 时取以 key 开头的区间，否则精确匹配
+    template<typename Map>
+    static std::pair<typename Map::const_iterator, typename Map::const_iterator> catalog_range(const Map &map, const std::string &key, bool prefix) {
+        if (key.empty()) {
+            return {map.begin(), map.end()};
+        }
+        if (! prefix) {
+            auto it = map.find(key);
+            return {it, it == map.end() ? it : std::next(it)};
+        }
+
+        auto upper = prefix_upper_bound(key);
+        return {map.lower_bound(key), upper.empty() ? map.end() : map.lower_bound(upper)};
+    }
+
+    // 忽略大小写的子串匹配
+    static bool contains_ignore_case(std::string_view s, std::string_view sub) {
+        return std::search(s.begin(), s.end(), sub.begin(), sub.end(), [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        }) != s.end();
+    }
+
+    // 方法列表的过滤与分页条件
+    struct ListQuery {
+        std::string pkg;
+        std::string cls;
+        std::string mtd;
+        bool prefix = false;   // package, class, method 按前缀匹配
+        std::string search;    // 完整路径包含该子串(忽略大小写)
+        size_t offset = 0;
+        size_t limit = 0;      // 0 表示不限
+    };
+
+    // 按过滤条件从方法目录生成列表，package/class/method 通过有序索引直接定位，只序列化当前页，需持有 REGISTRY_MUTEX
+    static nlohmann::json list_catalog(const ListQuery &q) {
+        int packageTotal = 0;
+        int classTotal = 0;
+        size_t methodTotal = 0;
+
+        json packageList = json::array();
+        size_t end = q.limit == 0 || q.limit > SIZE_MAX - q.offset ? SIZE_MAX : q.offset + q.limit;
+
+        auto prange = catalog_range(CATALOG, q.pkg, q.prefix);
+        for (auto pit = prange.first; pit != prange.second; ++pit) {
+            json classList = json::array();
+            int pkgMethodTotal = 0;
+            bool pkgMatched = false;
+
+            auto crange = catalog_range(pit->second, q.cls, q.prefix);
+            for (auto cit = crange.first; cit != crange.second; ++cit) {
+                json methodList = json::array();
+                bool clsMatched = false;
+
+                auto mrange = catalog_range(cit->second, q.mtd.empty() ? "" : FuncPath{pit->first, cit->first, q.mtd}.str(), q.prefix);
+                for (auto mit = mrange.first; mit != mrange.second; ++mit) {
+                    if (! q.search.empty() && ! contains_ignore_case(mit->first, q.search)) {
+                        continue;
+                    }
+
+                    clsMatched = true;
+                    size_t index = methodTotal ++;
+                    if (index < q.offset || index >= end) {
+                        continue;
+                    }
+
+                    const MethodInfo &info = mit->second;
+                    json mtdObj;
+                    mtdObj["name"] = info.name;
+                    mtdObj["parameterTypeList"] = info.parameterTypeList;
+                    mtdObj["genericParameterTypeList"] = info.parameterTypeList;
+                    mtdObj["returnType"] = info.returnType;
+                    mtdObj["genericReturnType"] = info.returnType;
+                    mtdObj["static"] = info.is_static;
+                    methodList.push_back(std::move(mtdObj));
+                }
+
+                if (! clsMatched) {
+                    continue;
+                }
+                pkgMatched = true;
+                classTotal ++;
+
+                if (methodList.empty()) {
+                    continue;
+                }
+
+                json clsObj;
+                clsObj["class"] = cit->first;
+                clsObj["methodTotal"] = methodList.size();
+                pkgMethodTotal += static_cast<int>(methodList.size());
+                clsObj["methodList"] = std::move(methodList);
+                classList.push_back(std::move(clsObj));
+            }
+
+            if (pkgMatched) {
+                packageTotal ++;
+            }
+            if (classList.empty()) {
+                continue;
+            }
+
+            json pkgObj;
+            pkgObj["package"] = pit->first;
+            pkgObj["classTotal"] = classList.size();
+            pkgObj["methodTotal"] = pkgMethodTotal;
+            pkgObj["classList"] = std::move(classList);
+            packageList.push_back(std::move(pkgObj));
+        }
+
+        // packageTotal, classTotal, methodTotal 是全部匹配的数量，packageList 只包含 offset, limit 指定的这一页
+        json result;
+        result["code"] = 200;
+        result["msg"] = "success";
+        result["packageTotal"] = packageTotal;
+        result["classTotal"] = classTotal;
+        result["methodTotal"] = methodTotal;
+        if (q.offset > 0 || q.limit > 0) {
+            result["offset"] = q.offset;
+            result["limit"] = q.limit;
+        }
+        result["packageList"] = std::move(packageList);
+        return result;
+    }
+
+    static nlohmann::json list_json(nlohmann::json j) {
+        nlohmann::json result;
+
+        try {
+            ListQuery q;
+
+            json method = j["method"];
+            q.mtd = method.empty() ? "" : method.get<std::string>();
+
+            json package = j["package"];
+            q.pkg = package.empty() ? "" : package.get<std::string>();
+
+            json clazz = j["class"];
+            q.cls = clazz.empty() ? "" : clazz.get<std::string>();
+
+            json prefix = j["prefix"];
+            q.prefix = prefix.is_boolean() && prefix.get<bool>();
+
+            json search = j["search"];
+            q.search = search.empty() ? "" : search.get<std::string>();
+
+            json offset = j["offset"];
+            json limit = j["limit"];
+            if ((! offset.empty() && ! offset.is_number_unsigned()) || (! limit.empty() && ! limit.is_number_unsigned())) {
+                throw std::runtime_error("offset and limit should be non-negative integers!");
+            }
+            q.offset = offset.empty() ? 0 : offset.get<size_t>();
+            q.limit = limit.empty() ? 0 : limit.get<size_t>();
+
+            std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+            result = list_catalog(q);
+        } catch (const nlohmann::json::parse_error& ex) {
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+            result = new_err_result(ex);
+        } catch (const nlohmann::json::type_error& ex) {
+            log_debug("nlohmann::json::type_error ", ex.what());
+            result = new_err_result(ex);
+        } catch (const nlohmann::json::other_error& ex) {
+            log_debug("nlohmann::json::other_error ", ex.what());
+            result = new_err_result(ex);
+        } catch (const std::exception& e) {
+            result = new_err_result(e);
+        }
+
+        return result;
+    }
+
+    // 进程启动时间，拼进 ETag，避免重启后版本号重复导致客户端误用旧缓存
+    static const long long CATALOG_EPOCH = current_time_millis();
+
+    static std::mutex CATALOG_CACHE_MUTEX;
+    static std::shared_ptr<const std::string> CATALOG_CACHE;
+    static uint64_t CATALOG_CACHE_VERSION = 0;
+
+    // 不带过滤条件的完整方法列表，序列化结果按 CATALOG_VERSION 缓存，目录没变时不重新生成
+    static std::shared_ptr<const std::string> list_dump(std::string &etag) {
+        std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+        std::lock_guard<std::mutex> cache_lock(CATALOG_CACHE_MUTEX);
+        if (CATALOG_CACHE == nullptr || CATALOG_CACHE_VERSION != CATALOG_VERSION) {
+            CATALOG_CACHE = std::make_shared<const std::string>(
+                list_catalog(ListQuery()).dump(-1, ' ', false, nlohmann::detail::error_handler_t::ignore)
+            );
+            CATALOG_CACHE_VERSION = CATALOG_VERSION;
+        }
+
+        etag = "\"" + std::to_string(CATALOG_EPOCH) + "-" + std::to_string(CATALOG_CACHE_VERSION) + "\"";
+        return CATALOG_CACHE;
+    }
+
+    // 请求体与响应体的编码，按 Content-Type 与 Accept 协商
+    enum BodyFormat {
+        FORMAT_JSON,
+        FORMAT_MSGPACK,
+        FORMAT_CBOR
+    };
+
+    static const char* body_content_type(BodyFormat format) {
+        switch (format) {
+            case FORMAT_MSGPACK: return "application/msgpack";
+            case FORMAT_CBOR: return "application/cbor";
+            default: return "application/json";
+        }
+    }
+
+    static json parse_body(std::string_view str, BodyFormat format) {
+        switch (format) {
+            case FORMAT_MSGPACK: return json::from_msgpack(str.begin(), str.end());
+            case FORMAT_CBOR: return json::from_cbor(str.begin(), str.end());
+            default: return json::parse(str);
+        }
+    }
+
+    static std::string dump_body(const json &j, BodyFormat format) {
+        std::string out;
+        switch (format) {
+            case FORMAT_MSGPACK:
+                json::to_msgpack(j, nlohmann::detail::output_adapter<char, std::string>(out));
+                break;
+            case FORMAT_CBOR:
+                json::to_cbor(j, nlohmann::detail::output_adapter<char, std::string>(out));
+                break;
+            default:
+                out = j.dump(-1, ' ', false, nlohmann::detail::error_handler_t::ignore);
+        }
+        return out;
+    }
+
+    static nlohmann::json list_str(std::string_view str, BodyFormat format = FORMAT_JSON) {
+        nlohmann::json result;
+        json j = json::object();
+        try {
+            if (str.find_first_not_of(" \t\r\n") != std::string_view::npos) {
+                j = parse_body(str, format);
+            }
+        } catch (const nlohmann::json::parse_error& e) {
+            result = new_err_result(e);
+        } catch (const nlohmann::json::type_error& e) {
+            result = new_err_result(e);
+        } catch (const nlohmann::json::other_error& e) {
+            result = new_err_result(e);
+        } catch (const std::exception& e) {
+            result = new_err_result(e);
+        }
+
+        if (! result.empty()) {
+            result["code"] = 400;
+            return result;
+        }
+
+        return list_json(j);
+    }
+
+
+
+    // 基准测试单次请求允许的最大 warmup + iterations，避免一个请求长时间占用工作线程
+    static size_t BENCHMARK_MAX_ITERATIONS = 1000000;
+
+    // 解析 "benchmark": {"warmup": N, "iterations": M}，传 true 时用默认值，不传或 false 时返回 false
+    static bool parse_benchmark(const json &b, size_t &warmup, size_t &iterations) {
+        warmup = 10;
+        iterations = 100;
+        if (b.is_null() || (b.is_boolean() && ! b.get<bool>())) {
+            return false;
+        }
+        if (b.is_boolean()) {
+            return true;
+        }
+        if (! b.is_object()) {
+            throw std::runtime_error("benchmark should be true or an object like {\"warmup\": 10, \"iterations\": 100}!");
+        }
+
+        auto w = b.find("warmup");
+        auto it = b.find("iterations");
+        if ((w != b.end() && ! w->is_number_unsigned()) || (it != b.end() && ! it->is_number_unsigned())) {
+            throw std::runtime_error("benchmark.warmup and benchmark.iterations should be non-negative integers!");
+        }
+        if (w != b.end()) {
+            warmup = w->get<size_t>();
+        }
+        if (it != b.end()) {
+            iterations = it->get<size_t>();
+        }
+        if (iterations <= 0 || warmup > BENCHMARK_MAX_ITERATIONS || iterations > BENCHMARK_MAX_ITERATIONS - warmup) {
+            throw std::runtime_error("benchmark.iterations should be in [1, " + std::to_string(BENCHMARK_MAX_ITERATIONS)
+                + "] and warmup + iterations should not exceed it!");
+        }
+        return true;
+    }
+
+    // 重复执行已解析好的函数并统计耗时(纳秒)。每次调用前在计时区外复制 this，并由 bind 转换好实参、构建好实例，
+    // 计时只包含函数本身，不写回 this，返回值在停止计时后才析构
+    template<typename Bind>
+    static json benchmark_func(const Bind &bind, const json &thiz, size_t warmup, size_t iterations) {
+        using clock = std::chrono::steady_clock;
+
+        for (size_t i = 0; i < warmup; ++i) {
+            json j = thiz;
+            BoundCall bound = bind(j);
+            Value r = bound.call();
+        }
+
+        std::vector<long long> samples;
+        samples.reserve(iterations);
+        for (size_t i = 0; i < iterations; ++i) {
+            json j = thiz;
+            BoundCall bound = bind(j);
+
+            auto t0 = clock::now();
+            Value r = bound.call();
+            auto t1 = clock::now();
+
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        size_t n = samples.size();
+        double sum = 0;
+        for (auto s : samples) {
+            sum += s;
+        }
+        double mean = sum / n;
+
+        double sq = 0;
+        for (auto s : samples) {
+            sq += (s - mean) * (s - mean);
+        }
+        double stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+
+        // 最近秩法取百分位
+        auto percentile = [&samples, n](double p) {
+            size_t rank = static_cast<size_t>(std::ceil(p * n));
+            return samples[rank <= 0 ? 0 : rank - 1];
+        };
+
+        json result;
+        result["warmup"] = warmup;
+        result["iterations"] = iterations;
+        result["unit"] = "ns";
+        result["min"] = samples.front();
+        result["median"] = percentile(0.5);
+        result["p90"] = percentile(0.9);
+        result["p99"] = percentile(0.99);
+        result["max"] = samples.back();
+        result["mean"] = mean;
+        result["stddev"] = stddev;
+        result["opsPerSecond"] = sum > 0 ? n * 1e9 / sum : 0;
+        return result;
+    }
+
+    // 硬件性能计数器，"perf": true 时包住被测函数的调用。第一个打开成功的计数器作为组长，其它加入同一组，
+    // 一起启停、一次读出，IPC 等比值来自同一段时间；不支持的(如容器中禁用了 perf_event_open)直接跳过，
+    // 全部不可用时只返回 available: false
+    class PerfCounters {
+    public:
+        PerfCounters() {
+#ifdef __linux__
+            open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles");
+            open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions");
+            open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cacheMisses");
+            open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branchMisses");
+            open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "contextSwitches");
+#endif
+        }
+
+        ~PerfCounters() {
+            for (auto it = counters.rbegin(); it != counters.rend(); ++ it) {
+                ::close(it->fd); // 先关组员再关组长
+            }
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        void start() {
+#ifdef __linux__
+            if (! counters.empty()) {
+                ioctl(counters.front().fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(counters.front().fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+
+        void stop() {
+#ifdef __linux__
+            if (! counters.empty()) {
+                ioctl(counters.front().fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+
+        json to_json() const {
+            json result;
+            result["available"] = ! counters.empty();
+            if (! error.empty()) {
+                result["msg"] = error; // 部分计数器不可用
+            }
+            if (counters.empty()) {
+                if (error.empty()) {
+                    result["msg"] = "perf_event_open is not supported on this platform";
+                }
+                return result;
+            }
+
+#ifdef __linux__
+            // 从组长一次读出整组：nr, time_enabled, time_running, value[nr]，顺序与打开顺序一致
+            std::vector<uint64_t> data(3 + counters.size(), 0);
+            ssize_t size = static_cast<ssize_t>(data.size() * sizeof(uint64_t));
+            if (::read(counters.front().fd, data.data(), size) != size || data[0] != counters.size()) {
+                result["available"] = false;
+                result["msg"] = "read perf counter group failed";
+                return result;
+            }
+            if (data[2] == 0) {
+                result["available"] = false;
+                result["msg"] = "perf counter group was never scheduled";
+                return result;
+            }
+
+            // 整组一起被调度，计数器被复用时按同一个运行时间比例换算
+            double scale = data[2] < data[1] ? static_cast<double>(data[1]) / data[2] : 1;
+            double cycles = -1;
+            double instructions = -1;
+            for (size_t i = 0; i < counters.size(); i ++) {
+                const Counter &c = counters[i];
+                double value = data[3 + i] * scale;
+                result[c.name] = static_cast<uint64_t>(value);
+                if (c.name == std::string("cycles")) {
+                    cycles = value;
+                } else if (c.name == std::string("instructions")) {
+                    instructions = value;
+                }
+            }
+
+            if (cycles > 0 && instructions >= 0) {
+                result["ipc"] = instructions / cycles;
+            }
+#endif
+            return result;
+        }
+
+    private:
+        struct Counter {
+            int fd;
+            const char* name;
+        };
+
+        std::vector<Counter> counters;
+        std::string error;
+
+#ifdef __linux__
+        void open_counter(uint32_t type, uint64_t config, const char* name) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            // 组长先禁用，由 start 整组启用；组员跟随组长
+            int group_fd = counters.empty() ? -1 : counters.front().fd;
+            attr.disabled = group_fd < 0 ? 1 : 0;
+
+            // 只统计当前线程，被测函数就在当前工作线程中执行
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0) {
+                error.append(error.empty() ? "" : "; ").append("perf_event_open(").append(name).append(") failed: ").append(strerror(errno));
+                return;
+            }
+            counters.push_back(Counter{fd, name});
+        }
+#endif
+    };
+
+    // 当前线程的堆分配计数，只有在某个翻译单元中先 #define UNITAUTO_ALLOC_HOOK 再包含本头文件，
+    // 替换了全局 operator new/delete 后才会计数
+    struct AllocStats {
+        bool active = false;
+        size_t allocs = 0;
+        size_t frees = 0;
+        size_t bytes = 0;
+    };
+
+    inline thread_local AllocStats ALLOC_STATS;
+
+    // 在作用域内统计当前线程的堆分配，"alloc": true 时包住被测函数的调用
+    class AllocScope {
+    public:
+        AllocScope() {
+            ALLOC_STATS = AllocStats();
+            ALLOC_STATS.active = true;
+        }
+
+        ~AllocScope() {
+            ALLOC_STATS.active = false;
+        }
+
+        AllocScope(const AllocScope&) = delete;
+        AllocScope& operator=(const AllocScope&) = delete;
+
+        void stop() {
+            ALLOC_STATS.active = false;
+            stats = ALLOC_STATS;
+        }
+
+        json to_json() const {
+            json result;
+#ifdef UNITAUTO_ALLOC_HOOK
+            result["available"] = true;
+            result["allocs"] = stats.allocs;
+            result["frees"] = stats.frees;
+            result["bytes"] = stats.bytes;
+#else
+            result["available"] = false;
+            result["msg"] = "#define UNITAUTO_ALLOC_HOOK before #include \"unitauto/method_util.hpp\" in one source file to enable it";
+#endif
+            return result;
+        }
+
+    private:
+        AllocStats stats;
+    };
+
+    // 从请求中移出字段，不存在时返回 null，不会像 operator[] 一样复制或插入
+    static json take_field(json &j, const char *key) {
+        if (! j.is_object()) {
+            return json();
+        }
+        auto it = j.find(key);
+        return it == j.end() ? json() : std::move(*it);
+    }
+
+    // 不带类型标注的实参：不是 "type:value" 字符串，也不是带 type 的 {"type": ..., "value": ...} 对象
+    static bool is_plain_arg(const json &arg) {
+        if (arg.is_string()) {
+            return arg.get_ref<const std::string&>().find(':') == std::string::npos;
+        }
+        if (arg.is_object()) {
+            auto it = arg.find("type");
+            return it == arg.end() || it->is_null();
+        }
+        return true;
+    }
+
+    // stream_ret 不为空且请求带 "stream": true 时，std::vector 返回值不转成 "return"，移动到 stream_ret 由调用方流式输出
+    // 请求按值传入，调用方应 std::move 进来；字段都从 j 中移出，不复制 args, this 等大的字段
+    static nlohmann::json invoke_json(nlohmann::json j, Value *stream_ret = nullptr) {
+        nlohmann::json result;
+
+        try {
+            json method = take_field(j, "method");
+            std::string mtd = method.empty() ? "" : method.get<std::string>();
+            if (mtd.empty()) {
+                throw std::runtime_error("method cannot be empty! should be a string!");
+            }
+
+            json package = take_field(j, "package");
+            std::string pkg = package.empty() ? "" : package.get<std::string>();
+
+            json clazz = take_field(j, "class");
+            std::string cls = clazz.empty() ? "" : clazz.get<std::string>();
+
+            FuncPath path{pkg, cls, mtd};
+
+            json clsArgs = take_field(j, "classArgs");
+
+            json thiz = take_field(j, "this");
+
+            json is_static = take_field(j, "static");
+
+            bool is_sttc;
+            bool is_sttc1 = (! is_static.empty()) && is_static.get<bool>();
+            bool is_sttc2 = path.front() != '&' && thiz.empty() && clsArgs.empty();
+
+            if (is_static.empty()) {
+                is_sttc = is_sttc2 && (cls.empty() || cls.at(0) < 'A' || cls.at(0) > 'Z');
+            }
+            else if (is_sttc1 && is_sttc1 != is_sttc2) {
+                throw std::runtime_error("static cannot be true while method path starts with '&' or this/classArgs is not empty!");
+            }
+            else {
+                is_sttc = is_sttc1;
+            }
+
+            json tt;
+            if (! is_sttc) {
+                tt = thiz["type"];
+                if (tt.empty()) {
+                    std::string t = (pkg.empty() ? "" : pkg + ".") + cls;
+                    thiz["type"] = tt = t;
+                }
+
+                std::string type = tt.get<std::string>();
+                json value = thiz["value"];
+                // this_ = json_2_obj(value, type);
+            } else if (! (thiz.empty() && clsArgs.empty())) {
+                throw std::runtime_error("static: true 时，this 和 classArgs 都必须不传或为空！");
+            }
+
+            nlohmann::json args_ = take_field(j, "args");
+            if (args_.empty()) {
+                args_ = take_field(j, "methodArgs");
+            }
+            if (args_.is_null()) {
+                args_ = json::array();
+            }
+
+            // 先解析出要执行的函数，计时、计数器、分配统计都只包住函数本身
+            prepare_this(thiz);
+            FuncRef fr = find_method(path);
+
+            // 有按形参类型生成的 JFT 且实参都不带类型标注时，实参直接从 JSON 解码成形参类型
+            bool typed = fr.jfunc && args_.is_array() && std::all_of(args_.begin(), args_.end(), is_plain_arg);
+
+            std::vector<std::any> args;
+            json methodArgs = json::array();
+
+            if (! typed) {
+                args.reserve(args_.size());
+            }
+            for (int i = 0; ! typed && i < args_.size(); ++i) {
+                auto &arg = args_.at(i);
+                std::any a;
+                std::string err;
+                if (! try_json_to_any(arg, a, err)) {
+                    return new_err_result(400, "args[" + std::to_string(i) + "]: " + err);
+                }
+                // std::any a = static_cast<std::any>(arg);
+
+                methodArgs.push_back(method_arg_json(a, arg));
+                args.push_back(std::move(a));
+            }
+
+            // 参数在调用时会被移动走，基准测试需要在调用前保留一份
+            size_t warmup, iterations;
+            bool is_bench = parse_benchmark(take_field(j, "benchmark"), warmup, iterations);
+            json bench_thiz;
+            std::vector<std::any> bench_args;
+            if (is_bench) {
+                bench_thiz = thiz;
+                if (! typed) {
+                    bench_args = args;
+                }
+            }
+
+            // 基准测试每次迭代在计时区外重新解码或复制实参、构建实例
+            std::vector<std::any> bench_a;
+            auto bench_bind = [&fr, &args_, &bench_args, &bench_a, typed](json &bj) -> BoundCall {
+                if (typed) {
+                    return fr.jfunc(bj, args_, nullptr);
+                }
+                bench_a = bench_args;
+                return fr.bind(bj, bench_a);
+            };
+
+            // 实参在计时区外转换好(typed 调用在这里解码，methodArgs 写入转换后的实参)，指针方式的实例也在这里构建
+            BoundCall bound = typed ? fr.jfunc(thiz, args_, &methodArgs) : fr.bind(thiz, args);
+
+            auto &metrics = fr.metrics;
+
+            json perf_ = take_field(j, "perf");
+            std::optional<PerfCounters> perf;
+            if (perf_.is_boolean() && perf_.get<bool>()) {
+                perf.emplace();
+            }
+
+            json alloc_ = take_field(j, "alloc");
+            std::optional<AllocScope> alloc;
+
+            if (perf) {
+                perf->start();
+            }
+            if (alloc_.is_boolean() && alloc_.get<bool>()) {
+                alloc.emplace();
+            }
+
+            long long start = current_time_millis();
+            Value ret;
+            try {
+                ret = bound.call();
+            } catch (...) {
+                metrics->observe(current_time_millis() - start, true);
+                throw;
+            }
+            long long end = current_time_millis();
+            metrics->observe(end - start, false);
+
+            if (alloc) {
+                alloc->stop();
+            }
+            if (perf) {
+                perf->stop();
+            }
+            // 停止计时后再把实例写回 this
+            if (bound.finish) {
+                bound.finish();
+            }
+
+            result = new_ok_result();
+            std::ostringstream time_str;
+            time_str << start << "|" << (end - start) << "|" << end;
+            result["time:start|duration|end"] = time_str.str();
+            if (perf) {
+                result["perf"] = perf->to_json();
+            }
+            if (alloc) {
+                result["alloc"] = alloc->to_json();
+            }
+
+            std::string type = ret.has_value() ? type_name(ret.type()) : "";
+            json stream_ = take_field(j, "stream");
+            if (! type.empty()) {
+                result["type"] = type;  // type_cs;
+
+                if (stream_ret != nullptr && stream_.is_boolean() && stream_.get<bool>() && ret.is_sequence()) {
+                    *stream_ret = std::move(ret);
+                } else {
+                    json v = std::move(ret).to_json(type);
+                    result["return"] = v;
+                }
+            }
+
+            if (! is_sttc) {
+                std::string type = tt.get<std::string>();
+                result["this"] = any_to_json(thiz, type);
+            }
+
+            if (is_bench) {
+                result["benchmark"] = benchmark_func(bench_bind, bench_thiz, warmup, iterations);
+            }
+
+            result["methodArgs"] = std::move(methodArgs); // any_to_json(args);
+        } catch (const ArgDecodeError& e) {
+            result = new_err_result(400, e.what());
+        } catch (const nlohmann::json::parse_error& ex) {
+            log_debug("nlohmann::json::parse_error at byte ", ex.byte, ": ", ex.what());
+            result = new_err_result(ex);
+        } catch (const nlohmann::json::type_error& ex) {
+            log_debug("nlohmann::json::type_error ", ex.what());
+            result = new_err_result(ex);
+        } catch (const nlohmann::json::other_error& ex) {
+            log_debug("nlohmann::json::other_error ", ex.what());
+            result = new_err_result(ex);
+        } catch (const std::exception& e) {
+            result = new_err_result(e);
+        }
+
+        return result;
+    }
+
 
-    static nlohmann::json list_json(nlohmann::json j) {
+    static nlohmann::json invoke_str(std::string_view str, Value *stream_ret = nullptr, BodyFormat format = FORMAT_JSON) {
         nlohmann::json result;
+        json j;
+        try {
+            j = parse_body(str, format);
+        } catch (const nlohmann::json::parse_error& e) {
+            result = new_err_result(e);
+        } catch (const nlohmann::json::type_error& e) {
+            result = new_err_result(e);
+        } catch (const nlohmann::json::other_error& e) {
+            result = new_err_result(e);
+        } catch (const std::exception& e) {
+            result = new_err_result(e);
+        }
+
+        if (! result.empty()) {
+            result["code"] = 400;
+            return result;
+        }
+
+        return invoke_json(std::move(j), stream_ret);
+    }
+
+
+    // 多个工作线程可能同时请求 /coverage/*，lcov 等命令需要串行执行
+    static std::mutex COVERAGE_MUTEX;
+
+    // 服务工作线程数，<= 0 时取 CPU 核数
+    static int SERVER_THREADS = 0;
+    // 等待处理的请求队列上限，队列满时不阻塞等待，新请求直接返回 503 并关闭连接
+    static int SERVER_QUEUE_SIZE = 1024;
+
+    // 固定线程数 + 有界队列的工作线程池
+    class WorkerPool {
+    public:
+        WorkerPool(int threads, int capacity) : capacity_(capacity <= 0 ? 1 : capacity) {
+            if (threads <= 0) {
+                threads = static_cast<int>(std::thread::hardware_concurrency());
+            }
+            if (threads <= 0) {
+                threads = 4;
+            }
+
+            for (int i = 0; i < threads; ++i) {
+                workers_.emplace_back([this] { work(); });
+            }
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool() {
+            shutdown();
+        }
+
+        // 提交任务，队列满时阻塞直到有空位；线程池已停止时返回 false
+        bool submit(std::function<void()> task) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this] { return stopped_ || queue_.size() < capacity_; });
+            if (stopped_) {
+                return false;
+            }
+
+            queue_.push_back(std::move(task));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        // 提交任务，队列满或线程池已停止时立即返回 false
+        bool try_submit(std::function<void()> task) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_ || queue_.size() >= capacity_) {
+                return false;
+            }
+
+            queue_.push_back(std::move(task));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        size_t queue_size() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return queue_.size();
+        }
+
+        size_t thread_count() const {
+            return workers_.size();
+        }
+
+        // 正在执行任务的线程数
+        size_t busy_count() const {
+            return busy_.load(std::memory_order_relaxed);
+        }
+
+        // 不再接受新任务，执行完已排队的任务后等待所有线程退出
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopped_) {
+                    return;
+                }
+                stopped_ = true;
+            }
+
+            not_empty_.notify_all();
+            not_full_.notify_all();
+            for (auto& w : workers_) {
+                if (w.joinable()) {
+                    w.join();
+                }
+            }
+        }
+
+    private:
+        void work() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    not_empty_.wait(lock, [this] { return stopped_ || ! queue_.empty(); });
+                    if (queue_.empty()) {
+                        return;
+                    }
+
+                    task = std::move(queue_.front());
+                    queue_.pop_front();
+                    not_full_.notify_one();
+                }
+
+                busy_.fetch_add(1, std::memory_order_relaxed);
+                try {
+                    task();
+                } catch (const std::exception& e) {
+                    log_error("WorkerPool task error: ", e.what());
+                } catch (...) {
+                    log_error("WorkerPool task error: unknown");
+                }
+                busy_.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        size_t capacity_;
+        bool stopped_ = false;
+        std::atomic<size_t> busy_{0};
+        std::deque<std::function<void()>> queue_;
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+    };
+
+    // 当前服务使用的工作线程池，start 时设置，批量调用等需要并行执行时使用
+    static WorkerPool* SERVER_POOL = nullptr;
+
+    // 并行执行 fn(0) ... fn(n - 1)：调用线程自己也参与执行，线程池没有空闲时就退化为串行，
+    // 所以在工作线程中调用也不会因为等待排队的任务而死锁
+    static void parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+        WorkerPool* pool = SERVER_POOL;
+        if (n <= 1 || pool == nullptr) {
+            for (size_t i = 0; i < n; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next{0};
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+        auto state = std::make_shared<State>();
+
+        // 任务可能在所有元素处理完之后才开始执行，此时 fn 已失效，所以先检查 next 再访问 fn
+        auto run = [state, n, &fn] {
+            size_t count = 0;
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < n) {
+                fn(i);
+                count ++;
+            }
+
+            if (count > 0) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done += count;
+                if (state->done >= n) {
+                    state->cv.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min(n - 1, pool->thread_count());
+        for (size_t k = 0; k < helpers; ++k) {
+            if (! pool->try_submit(run)) {
+                break;
+            }
+        }
+
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->done >= n; });
+    }
+
+    // 批量调用，一次解析所有调用对象：
+    // [{...}, {...}] 返回结果数组；{"list": [{...}, {...}], "parallel": true} 返回 {"code": 200, "list": [...]}，
+    // parallel 为 true 时用工作线程池并行执行，被测函数需要是线程安全的
+    static nlohmann::json invoke_batch_json(nlohmann::json j) {
+        bool is_arr = j.is_array();
+        bool parallel = false;
+        json list;
+
+        if (is_arr) {
+            list = std::move(j);
+        } else if (j.is_object()) {
+            json p = j["parallel"];
+            parallel = p.is_boolean() && p.get<bool>();
+            list = std::move(j["list"]);
+        }
+
+        if (! list.is_array()) {
+            return new_err_result(400, "body should be an array of invocation objects, or an object with list: [...]!");
+        }
+
+        size_t n = list.size();
+        std::vector<json> rets(n);
+        auto fn = [&list, &rets](size_t i) {
+            rets[i] = invoke_json(std::move(list[i]));
+        };
+
+        if (parallel) {
+            parallel_for(n, fn);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                fn(i);
+            }
+        }
+
+        json results = json::array();
+        for (auto& r : rets) {
+            results.push_back(std::move(r));
+        }
+
+        if (is_arr) {
+            return results;
+        }
+
+        json result = new_ok_result();
+        result["total"] = n;
+        result["list"] = std::move(results);
+        return result;
+    }
 
+    static nlohmann::json invoke_batch_str(std::string_view str, BodyFormat format = FORMAT_JSON) {
+        nlohmann::json result;
+        json j;
         try {
-            json method = j["method"];
-            std::string mtd = method.empty() ? "" : method.get<std::string>();
+            j = parse_body(str, format);
+        } catch (const nlohmann::json::parse_error& e) {
+            result = new_err_result(e);
+        } catch (const std::exception& e) {
+            result = new_err_result(e);
+        }
 
-            json package = j["package"];
-            std::string pkg = package.empty() ? "" : package.get<std::string>();
+        if (! result.empty()) {
+            result["code"] = 400;
+            return result;
+        }
+
+        return invoke_batch_json(std::move(j));
+    }
+
+    // 生成覆盖率报告
+    void generate_coverage_report() {
+        std::lock_guard<std::mutex> lock(COVERAGE_MUTEX);
+        // 生成覆盖率数据
+        system("lcov --capture --directory . --output-file coverage.info");
+        // 过滤掉不需要的数据
+        system("lcov --remove coverage.info '/usr/*' '*/tests/*' '*/external/*' --output-file coverage_filtered.info");
+        // 生成 HTML 报告
+        system("genhtml coverage_filtered.info --output-directory coverage");
+    }
+
+    static std::atomic<bool> coverage_enabled = false;
+
+    // 清除之前的覆盖率数据
+    void reset_coverage_data() {
+        std::lock_guard<std::mutex> lock(COVERAGE_MUTEX);
+        system("lcov --directory . --zerocounters");
+    }
+
+    // 启动覆盖率统计
+    void start_coverage() {
+        if (! coverage_enabled.exchange(true)) {
+            reset_coverage_data();
+            log_info("Coverage collection started.");
+        }
+    }
+
+    // 停止覆盖率统计并生成报告
+    void stop_coverage() {
+        if (coverage_enabled.exchange(false)) {
+            log_info("Coverage collection stopped.");
+            generate_coverage_report();
+        }
+    }
+
+    // 读取文件内容
+    std::string read_file(const std::string& file_path) {
+        std::ifstream file(file_path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+
+    // 处理请求并生成响应
+    // 发送全部数据，返回 false 表示连接已出错
+    static bool send_all(int client_socket, const char* data, size_t size) {
+        size_t sent = 0;
+        while (sent < size) {
+            ssize_t n = send(client_socket, data + sent, size - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    // 写出一块流式响应数据，返回 false 表示连接已关闭，应停止输出
+    using ChunkSink = std::function<bool(std::string &&chunk)>;
+
+    // HTTP 响应，头和体分开保存，发送时一起聚集写出，响应体不用再拼接到头后面复制一次；
+    // stream 不为空时头和 body 发送后再调用它按 chunked 编码逐块写出剩余的响应体
+    struct HttpResponse {
+        std::string head;
+        std::string body;
+        std::function<bool(const ChunkSink &sink)> stream;
+    };
+
+    // 流式响应每块的字节数
+    static size_t HTTP_STREAM_CHUNK_SIZE = 64 * 1024;
+
+    // 流式响应在事件循环中最多积压的字节数，超过时工作线程等待发送
+    static size_t HTTP_STREAM_BUFFER_SIZE = 1024 * 1024;
+
+    // 响应体的压缩编码，按 Accept-Encoding 协商
+    enum ContentEncoding {
+        ENCODING_IDENTITY,
+        ENCODING_GZIP,
+        ENCODING_DEFLATE
+    };
+
+    // 小于这个字节数的响应体不压缩
+    static size_t HTTP_COMPRESS_MIN_SIZE = 1024;
+
+    // zlib 压缩级别 1~9
+    static int HTTP_COMPRESS_LEVEL = 6;
+
+#ifdef UNITAUTO_ZLIB
+    // 增量压缩，同一个实例可以多次 compress，最后一次 finish 为 true 时写出结尾
+    class Compressor {
+    public:
+        explicit Compressor(ContentEncoding encoding) {
+            int bits = encoding == ENCODING_GZIP ? 15 + 16 : 15; // +16 为 gzip 头，否则为 zlib 格式(HTTP deflate)
+            ok_ = deflateInit2(&zs_, HTTP_COMPRESS_LEVEL, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+
+        ~Compressor() {
+            if (ok_) {
+                deflateEnd(&zs_);
+            }
+        }
+
+        Compressor(const Compressor&) = delete;
+        Compressor& operator=(const Compressor&) = delete;
+
+        // 压缩 in 并追加到 out
+        bool compress(std::string_view in, std::string &out, bool finish) {
+            if (! ok_) {
+                return false;
+            }
+
+            zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+            zs_.avail_in = static_cast<uInt>(in.size());
+            int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+            do {
+                size_t old = out.size();
+                size_t room = std::max<size_t>(16 * 1024, in.size() / 4);
+                out.resize(old + room);
+                zs_.next_out = reinterpret_cast<Bytef*>(out.data() + old);
+                zs_.avail_out = static_cast<uInt>(room);
+                ok_ = deflate(&zs_, flush) != Z_STREAM_ERROR;
+                out.resize(old + room - zs_.avail_out);
+            } while (ok_ && zs_.avail_out == 0);
+            return ok_;
+        }
+
+    private:
+        z_stream zs_{};
+        bool ok_ = false;
+    };
+#endif
+
+    // 按 Accept-Encoding 选择压缩编码，优先 gzip，q=0 表示不接受；没有定义 UNITAUTO_ZLIB 时不压缩
+    static ContentEncoding accept_encoding(std::string_view header) {
+#ifdef UNITAUTO_ZLIB
+        bool gzip = false, deflate = false;
+        while (! header.empty()) {
+            auto comma = header.find(',');
+            std::string_view item = header.substr(0, comma);
+            header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+            auto semi = item.find(';');
+            std::string_view name = item.substr(0, semi);
+            while (! name.empty() && (name.front() == ' ' || name.front() == '\t')) {
+                name.remove_prefix(1);
+            }
+            while (! name.empty() && (name.back() == ' ' || name.back() == '\t')) {
+                name.remove_suffix(1);
+            }
+
+            if (semi != std::string_view::npos) {
+                std::string_view params = item.substr(semi + 1);
+                auto q = params.find("q=");
+                if (q != std::string_view::npos && std::strtod(std::string(params.substr(q + 2)).c_str(), nullptr) <= 0) {
+                    continue;
+                }
+            }
+
+            if (name.size() == 4 && strncasecmp(name.data(), "gzip", 4) == 0) {
+                gzip = true;
+            } else if (name.size() == 7 && strncasecmp(name.data(), "deflate", 7) == 0) {
+                deflate = true;
+            }
+        }
+        return gzip ? ENCODING_GZIP : (deflate ? ENCODING_DEFLATE : ENCODING_IDENTITY);
+#else
+        return ENCODING_IDENTITY;
+#endif
+    }
+
+    // 整个响应体一次压缩，失败时返回 false
+    static bool compress_body(std::string_view in, ContentEncoding encoding, std::string &out) {
+#ifdef UNITAUTO_ZLIB
+        Compressor compressor(encoding);
+        out.reserve(in.size() / 4 + 64);
+        return compressor.compress(in, out, true);
+#else
+        return false;
+#endif
+    }
+
+    // 压缩后的表示与原文不同，强 ETag 要带上编码，例如 "1-2" -> "1-2-gzip"
+    static std::string encoded_etag(const std::string &etag, ContentEncoding encoding) {
+        if (encoding == ENCODING_IDENTITY || etag.size() < 2) {
+            return etag;
+        }
+        return etag.substr(0, etag.size() - 1) + (encoding == ENCODING_GZIP ? "-gzip\"" : "-deflate\"");
+    }
+
+    // 按 chunked 编码输出，攒够 HTTP_STREAM_CHUNK_SIZE 字节再交给 sink，encoding 不为 identity 时先压缩
+    class ChunkedWriter {
+    public:
+        explicit ChunkedWriter(const ChunkSink &sink, ContentEncoding encoding = ENCODING_IDENTITY) : sink_(sink) {
+#ifdef UNITAUTO_ZLIB
+            if (encoding != ENCODING_IDENTITY) {
+                compressor_.emplace(encoding);
+            }
+#endif
+        }
+
+        bool write(std::string_view data) {
+            buf_.append(data);
+            return buf_.size() < HTTP_STREAM_CHUNK_SIZE ? ok_ : flush();
+        }
+
+        // JSON 直接序列化到缓冲区，不生成中间字符串
+        bool write_json(const json &j) {
+            nlohmann::detail::serializer<json> s(nlohmann::detail::output_adapter<char, std::string>(buf_), ' ',
+                nlohmann::detail::error_handler_t::ignore);
+            s.dump(j, false, false, 0);
+            return buf_.size() < HTTP_STREAM_CHUNK_SIZE ? ok_ : flush();
+        }
+
+        // last 为 true 时压缩流也一起结束
+        bool flush(bool last = false) {
+            if ((buf_.empty() && ! last) || ! ok_) {
+                return ok_;
+            }
+
+            std::string_view data = buf_;
+#ifdef UNITAUTO_ZLIB
+            std::string compressed;
+            if (compressor_) {
+                if (! compressor_->compress(buf_, compressed, last)) {
+                    return ok_ = false;
+                }
+                data = compressed;
+            }
+#endif
+            if (data.empty()) {
+                buf_.clear();
+                return ok_; // 空块表示结束，不能写出
+            }
+
+            char size[24];
+            int n = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+            std::string chunk;
+            chunk.reserve(n + data.size() + 2);
+            chunk.append(size, n).append(data).append("\r\n");
+            buf_.clear();
+            ok_ = sink_(std::move(chunk));
+            return ok_;
+        }
+
+        // 写出剩余数据和结束块
+        bool finish() {
+            return flush(true) && (ok_ = sink_("0\r\n\r\n"));
+        }
+
+    private:
+        const ChunkSink &sink_;
+        std::string buf_;
+        bool ok_ = true;
+#ifdef UNITAUTO_ZLIB
+        std::optional<Compressor> compressor_;
+#endif
+    };
+
+    // 流式输出 invoke_json 的结果：先写出不含 return 的结果，再逐个元素写出 return 数组
+    static std::function<bool(const ChunkSink &sink)> stream_result(std::string envelope, Value &&ret, ContentEncoding encoding) {
+        auto value = std::make_shared<Value>(std::move(ret));
+        return [envelope = std::move(envelope), value, encoding](const ChunkSink &sink) -> bool {
+            ChunkedWriter writer(sink, encoding);
+            writer.write(std::string_view(envelope).substr(0, envelope.size() - 1));
+            writer.write(envelope.size() > 2 ? ",\"return\":[" : "\"return\":[");
+
+            bool first = true;
+            bool ok = value->each([&writer, &first](const json &e) {
+                if (! first && ! writer.write(",")) {
+                    return false;
+                }
+                first = false;
+                return writer.write_json(e);
+            });
 
-            json clazz = j["class"];
-            std::string cls = clazz.empty() ? "" : clazz.get<std::string>();
+            return ok && writer.write("]}") && writer.finish();
+        };
+    }
 
-            int packageTotal = 0;
-            int classTotal = 0;
-            int methodTotal = 0;
+    // 连接上待发送的数据块，用 sendmsg 一次写出多块并处理部分发送；
+    // 非阻塞 socket 写满时保留剩余数据，等可写后继续
+    class OutputQueue {
+    public:
+        void push(std::string data) {
+            if (! data.empty()) {
+                if (chunks_.empty()) {
+                    last_progress_ = std::chrono::steady_clock::now();
+                }
+                chunks_.push_back(std::move(data));
+            }
+        }
 
-            json packageList;
+        void push(HttpResponse &&response) {
+            push(std::move(response.head));
+            push(std::move(response.body));
+        }
 
-            for (const auto& kv : FUNC_MAP) {
-                auto key = kv.first;
-                auto value = kv.second;
-
-                auto ind = key.find_last_of('.');
-                std::string pkg2 = "";
-                std::string cls2 = "";
-                std::string mtd2 = "";
-                while (ind != std::string::npos && ind >= 0) {
-                    if (mtd2.empty()) {
-                        mtd2 = key.substr(ind + 1);
-                    } else {
-                        auto last = key.substr(ind + 1);
-                        auto first = cls2.empty() ? last.at(0) : '0';
-                        if (first >= 'A' && first <= 'Z') {
-                            cls2 = last;
-                        }
-                        else {
-                            pkg2 += (pkg2.empty() ? "" : ".") + last;
-                        }
-                    }
+        bool empty() const {
+            return chunks_.empty();
+        }
 
-                    key = key.substr(0, ind);
-                    ind = key.find_last_of('.');
-                }
+        // 有数据待发送，且从开始等待或上次发出数据起已超过 timeout，对端可能不再读取
+        bool stalled(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration timeout) const {
+            return ! chunks_.empty() && now - last_progress_ >= timeout;
+        }
 
-                if (mtd2.empty()) {
-                    mtd2 = key;
+        // 尽量发送全部数据，返回 false 表示连接已出错
+        bool flush(int fd) {
+            while (! chunks_.empty()) {
+                iovec iov[16];
+                size_t count = 0;
+                for (auto it = chunks_.begin(); it != chunks_.end() && count < 16; ++it, ++count) {
+                    size_t offset = count == 0 ? offset_ : 0;
+                    iov[count].iov_base = const_cast<char*>(it->data()) + offset;
+                    iov[count].iov_len = it->size() - offset;
                 }
 
-                if ((pkg2 != pkg && ! pkg.empty()) || (cls2 != cls && ! cls.empty()) || (mtd2 != mtd && ! mtd.empty())) {
+                msghdr msg{};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = count;
+                ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) {
                     continue;
                 }
-
-                std::string path2 = "";
-                if (! cls.empty()) {
-                    path2 = cls + "." + path2;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return true;
                 }
-                if (! pkg.empty()) {
-                    path2 = pkg + "." + path2;
+                if (n <= 0) {
+                    return false;
                 }
+                consume(n);
+                last_progress_ = std::chrono::steady_clock::now();
+            }
+            return true;
+        }
 
-                auto it = FUNC_MAP.find(path2);
-                if (it == FUNC_MAP.end()) {
-                    it = FUNC_MAP.find(mtd2);
+    private:
+        void consume(size_t n) {
+            while (n > 0) {
+                size_t left = chunks_.front().size() - offset_;
+                if (n < left) {
+                    offset_ += n;
+                    return;
                 }
+                n -= left;
+                chunks_.pop_front();
+                offset_ = 0;
+            }
+        }
 
-                if (it == FUNC_MAP.end()) {
-                    continue;
-                }
+        std::deque<std::string> chunks_;
+        size_t offset_ = 0; // 第一块已发送的字节数
+        std::chrono::steady_clock::time_point last_progress_;
+    };
 
-                auto func = it->second;
-                if (func == nullptr) {
-                    continue;
-                }
+    // 请求头及请求体的最大字节数，超过则直接关闭连接
+    static size_t SERVER_MAX_REQUEST_SIZE = 64 * 1024 * 1024;
 
-                using traits = function_traits<decltype(func)>;
-                // std::cout << "Argument types: ";
-                // std::apply( { ((std::cout << typeid(args).name() << " "), ...); }, traits::argument_types{});
-                // std::cout << std::endl;
-
-                json mtdObj;
-                mtdObj["name"] = mtd2;
-                // mtdObj["parameterTypeList"] = parameterTypeList;
-                // mtdObj["genericParameterTypeList"] = genericParameterTypeList;
-                mtdObj["returnType"] = trim_type(demangle(typeid(traits::return_type).name()));
-                mtdObj["genericReturnType"] = trim_type(demangle(typeid(traits::return_type).name()));
-                // mtdObj["static"] = is_static;
-                // mtdObj["exceptionTypeList"] = exceptionTypeList;
-                // mtdObj["genericExceptionTypeList"] = genericExceptionTypeList;
-                // mtdObj["parameterDefaultValueList"] = parameterDefaultValueList;
-
-
-                json pkgObj;
-                int pkgInd = -1;
-                for (int i = 0; i < packageList.size(); ++i) {
-                    json po = packageList[i];
-                    if (po["package"] == pkg2) {
-                        pkgObj = po;
-                        pkgInd = i;
-                        break;
-                    }
-                }
+    // 请求头的最大字节数
+    static size_t SERVER_MAX_HEADER_SIZE = 64 * 1024;
+
+    // 忽略大小写比较
+    static bool iequals(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+    }
 
-                if (pkgObj.empty()) {
-                    pkgObj["package"] = pkg2;
-                    pkgObj["classTotal"] = 1;
+    // 忽略大小写查找子串
+    static bool icontains(std::string_view s, std::string_view sub) {
+        if (sub.size() > s.size()) {
+            return false;
+        }
+        for (size_t i = 0; i + sub.size() <= s.size(); ++i) {
+            if (strncasecmp(s.data() + i, sub.data(), sub.size()) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-                    packageList.push_back(pkgObj);
-                    packageTotal ++;
-                } else {
-                    auto t = pkgObj["classTotal"] ;
-                    pkgObj["classTotal"] = t.get<int>() + 1;
-                }
+    // 去掉首尾空格和制表符
+    static std::string_view trim_view(std::string_view v) {
+        while (! v.empty() && (v.front() == ' ' || v.front() == '\t')) {
+            v.remove_prefix(1);
+        }
+        while (! v.empty() && (v.back() == ' ' || v.back() == '\t')) {
+            v.remove_suffix(1);
+        }
+        return v;
+    }
 
-                if (packageList.empty()) {
-                    packageList.push_back(pkgObj);
+    // 解析完成的 HTTP 请求，method/path/header/body 都直接指向 raw(或 chunked 解码后的 decoded)，不复制；
+    // 移动 raw 会让这些视图失效，所以请求创建后不再移动，跨线程时用 std::shared_ptr 传递
+    struct HttpRequest {
+        std::string raw;
+        std::string decoded;
+        std::string_view method;
+        std::string_view path;
+        std::string_view version;
+        std::vector<std::pair<std::string_view, std::string_view>> headers;
+        std::string_view body;
+
+        HttpRequest() = default;
+        HttpRequest(const HttpRequest&) = delete;
+        HttpRequest& operator=(const HttpRequest&) = delete;
+
+        // 按名称(忽略大小写)取 header 值，不存在时返回空
+        std::string_view header(std::string_view name) const {
+            for (const auto& h : headers) {
+                if (iequals(h.first, name)) {
+                    return h.second;
                 }
+            }
+            return {};
+        }
+    };
 
-                json classList = pkgObj["classList"];
+    // 增量式 HTTP 请求解析器(状态机)：数据直接读入可增长的缓冲区，记录已解析的位置，新数据到来时不重复扫描；
+    // 支持 Content-Length 和 Transfer-Encoding: chunked，同一缓冲区中可以有多个管线化的请求
+    class HttpParser {
+    public:
+        enum Status { NEED_MORE, COMPLETE, ERROR };
 
-                json clsObj;
-                int clsInd = -1;
-                for (int i = 0; i < classList.size(); ++i) {
-                    json co = classList[i];
-                    if (co["class"] == cls2) {
-                        clsObj = co;
-                        clsInd = i;
+        // 返回至少可写入 n 字节的位置，写入后调用 commit 确认写入的字节数
+        char* prepare(size_t n) {
+            if (buffer_.size() < size_ + n) {
+                buffer_.resize(std::max(size_ + n, buffer_.size() * 2));
+            }
+            return &buffer_[size_];
+        }
+
+        void commit(size_t n) {
+            size_ += n;
+        }
+
+        void append(const char* data, size_t n) {
+            memcpy(prepare(n), data, n);
+            commit(n);
+        }
+
+        // 缓冲区中的字节数，包括还未解析的后续请求
+        size_t buffered() const {
+            return size_;
+        }
+
+        // 客户端发送了 Expect: 100-continue 且请求体还未收到时返回 true，每个请求只返回一次
+        bool take_continue() {
+            bool c = continue_;
+            continue_ = false;
+            return c;
+        }
+
+        int error_status() const {
+            return error_status_;
+        }
+
+        const std::string& error() const {
+            return error_;
+        }
+
+        // 继续解析缓冲区中的数据
+        Status parse() {
+            std::string_view buf(buffer_.data(), size_);
+
+            while (true) {
+                switch (state_) {
+                    case HEADERS: {
+                        size_t end = buf.find("\r\n\r\n", pos_ > 3 ? pos_ - 3 : 0);
+                        if (end == std::string_view::npos) {
+                            pos_ = size_;
+                            if (size_ > SERVER_MAX_HEADER_SIZE) {
+                                return fail(431, "Request header fields too large");
+                            }
+                            return NEED_MORE;
+                        }
+
+                        header_end_ = end + 4;
+                        if (! parse_headers(buf)) {
+                            return ERROR;
+                        }
+
+                        pos_ = header_end_;
+                        state_ = chunked_ ? CHUNK_SIZE : BODY;
+                        continue_ = expect_continue_ && (chunked_ || size_ - header_end_ < content_length_);
+                        break;
+                    }
+                    case BODY: {
+                        if (size_ - header_end_ < content_length_) {
+                            return NEED_MORE;
+                        }
+                        pos_ = header_end_ + content_length_;
+                        state_ = DONE;
+                        break;
+                    }
+                    case CHUNK_SIZE: {
+                        size_t eol = buf.find("\r\n", pos_);
+                        if (eol == std::string_view::npos) {
+                            if (size_ - pos_ > 1024) {
+                                return fail(400, "Invalid chunk size line");
+                            }
+                            return NEED_MORE;
+                        }
+
+                        size_t chunk_size = 0;
+                        size_t i = pos_;
+                        for (; i < eol; ++i) {
+                            char ch = buf[i];
+                            int d = ch >= '0' && ch <= '9' ? ch - '0' : (ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1));
+                            if (d < 0) {
+                                break;
+                            }
+                            chunk_size = chunk_size * 16 + d;
+                            if (chunk_size > SERVER_MAX_REQUEST_SIZE) {
+                                return fail(413, "Request entity too large");
+                            }
+                        }
+                        if (i == pos_ || (i < eol && buf[i] != ';' && buf[i] != ' ' && buf[i] != '\t')) {
+                            return fail(400, "Invalid chunk size");
+                        }
+
+                        pos_ = eol + 2;
+                        if (chunk_size == 0) {
+                            state_ = TRAILERS;
+                        } else {
+                            if (decoded_.size() + chunk_size > SERVER_MAX_REQUEST_SIZE) {
+                                return fail(413, "Request entity too large");
+                            }
+                            chunk_remaining_ = chunk_size;
+                            state_ = CHUNK_DATA;
+                        }
+                        break;
+                    }
+                    case CHUNK_DATA: {
+                        size_t n = std::min(size_ - pos_, chunk_remaining_);
+                        decoded_.append(buffer_.data() + pos_, n);
+                        pos_ += n;
+                        chunk_remaining_ -= n;
+                        if (chunk_remaining_ > 0) {
+                            return NEED_MORE;
+                        }
+                        state_ = CHUNK_DATA_END;
+                        break;
+                    }
+                    case CHUNK_DATA_END: {
+                        if (size_ - pos_ < 2) {
+                            return NEED_MORE;
+                        }
+                        if (buf[pos_] != '\r' || buf[pos_ + 1] != '\n') {
+                            return fail(400, "Invalid chunk data");
+                        }
+                        pos_ += 2;
+                        state_ = CHUNK_SIZE;
+                        break;
+                    }
+                    case TRAILERS: {
+                        size_t eol = buf.find("\r\n", pos_);
+                        if (eol == std::string_view::npos) {
+                            return NEED_MORE;
+                        }
+                        bool last = eol == pos_;
+                        pos_ = eol + 2;
+                        if (last) {
+                            state_ = DONE;
+                        }
                         break;
                     }
+                    case DONE:
+                        return COMPLETE;
+                    case FAILED:
+                        return ERROR;
                 }
+            }
+        }
 
-                if (clsObj.empty()) {
-                    // auto clsConf = json_2_obj("", pkg2.empty() ? cls2 : pkg2 + "." + cls2);
-                    // if (clsConf == nullptr) {
-                    //     clsConf = json_2_obj("", cls2);
-                    // }
+        // 取出已完整解析的请求，缓冲区直接移交给请求，剩余数据(管线化的后续请求)留在解析器中
+        void take(HttpRequest& req) {
+            std::string leftover(buffer_.data() + pos_, size_ - pos_);
+
+            req.raw = std::move(buffer_);
+            req.raw.resize(pos_);
+            req.decoded = std::move(decoded_);
+
+            const char* base = req.raw.data();
+            req.method = std::string_view(base + method_.off, method_.len);
+            req.path = std::string_view(base + path_.off, path_.len);
+            req.version = std::string_view(base + version_.off, version_.len);
+            req.headers.clear();
+            req.headers.reserve(headers_.size());
+            for (const auto& h : headers_) {
+                req.headers.emplace_back(std::string_view(base + h.first.off, h.first.len), std::string_view(base + h.second.off, h.second.len));
+            }
+            req.body = chunked_ ? std::string_view(req.decoded) : std::string_view(base + header_end_, content_length_);
+
+            buffer_ = std::move(leftover);
+            size_ = buffer_.size();
+            pos_ = 0;
+            state_ = HEADERS;
+            headers_.clear();
+            decoded_.clear();
+            header_end_ = content_length_ = chunk_remaining_ = 0;
+            chunked_ = expect_continue_ = continue_ = false;
+        }
 
-                    clsObj["class"] = cls2;
-                    // 父类 clsObj["type"] = typeid(clsConf).name();
-                    clsObj["methodTotal"] = 1;
+    private:
+        enum State { HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, TRAILERS, DONE, FAILED };
 
-                    classList.push_back(clsObj);
-                    classTotal ++;
-                } else {
-                    auto t = clsObj["methodTotal"] ;
-                    pkgObj["methodTotal"] = t.get<int>() + 1;
-                }
+        struct Range {
+            size_t off;
+            size_t len;
+        };
 
-                if (classList.empty()) {
-                    classList.push_back(clsObj);
-                }
+        Status fail(int status, const std::string& msg) {
+            state_ = FAILED;
+            error_status_ = status;
+            error_ = msg;
+            return ERROR;
+        }
 
-                json methodList = clsObj["methodList"];
-                methodList.push_back(mtdObj);
-                methodTotal ++;
+        static Range range(std::string_view buf, std::string_view part) {
+            return {static_cast<size_t>(part.data() - buf.data()), part.size()};
+        }
+
+        // 解析请求行和请求头，只记录位置，缓冲区扩容后仍然有效
+        bool parse_headers(std::string_view buf) {
+            size_t line_end = buf.find("\r\n");
+            std::string_view line = buf.substr(0, line_end);
+            size_t sp1 = line.find(' ');
+            size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+            if (sp2 == std::string_view::npos || sp1 == 0 || sp2 == sp1 + 1) {
+                fail(400, "Invalid request line");
+                return false;
+            }
 
-                clsObj["methodList"] = methodList;
+            std::string_view version = trim_view(line.substr(sp2 + 1));
+            if (version.substr(0, 5) != "HTTP/") {
+                fail(400, "Invalid HTTP version");
+                return false;
+            }
 
-                if (clsInd < 0) {
-                    clsInd = static_cast<int>(classList.size()) - 1;
+            method_ = range(buf, line.substr(0, sp1));
+            path_ = range(buf, line.substr(sp1 + 1, sp2 - sp1 - 1));
+            version_ = range(buf, version);
+
+            // 同时有 Content-Length 与 Transfer-Encoding，或者多个不同的 Content-Length，
+            // 前后端对请求边界的理解可能不一致(请求走私)，在管线化的长连接上直接拒绝
+            bool has_length = false;
+            bool has_encoding = false;
+            std::string_view last_coding;
+            size_t pos = line_end + 2;
+            while (pos < header_end_ - 2) {
+                size_t eol = buf.find("\r\n", pos);
+                std::string_view h = buf.substr(pos, eol - pos);
+                pos = eol + 2;
+
+                size_t colon = h.find(':');
+                if (colon == std::string_view::npos || colon == 0) {
+                    fail(400, "Invalid header line");
+                    return false;
                 }
-                classList[clsInd] = clsObj;
-                pkgObj["classList"] = classList;
 
-                if (pkgInd < 0) {
-                    pkgInd = static_cast<int>(packageList.size()) - 1;
+                std::string_view name = trim_view(h.substr(0, colon));
+                std::string_view value = trim_view(h.substr(colon + 1));
+                headers_.emplace_back(range(buf, name), range(buf, value));
+
+                if (iequals(name, "Content-Length")) {
+                    if (value.empty() || value.find_first_not_of("0123456789") != std::string_view::npos) {
+                        fail(400, "Invalid Content-Length");
+                        return false;
+                    }
+                    size_t length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                    if (has_length && length != content_length_) {
+                        fail(400, "Conflicting Content-Length");
+                        return false;
+                    }
+                    content_length_ = length;
+                    if (content_length_ > SERVER_MAX_REQUEST_SIZE) {
+                        fail(413, "Request entity too large");
+                        return false;
+                    }
+                    has_length = true;
+                }
+                else if (iequals(name, "Transfer-Encoding")) {
+                    // 多个 Transfer-Encoding 按顺序拼成一个列表，只支持 chunked，且必须是最后一个编码
+                    has_encoding = true;
+                    while (! value.empty()) {
+                        size_t comma = value.find(',');
+                        std::string_view coding = trim_view(value.substr(0, comma));
+                        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+                        if (coding.empty()) {
+                            continue;
+                        }
+                        if (! last_coding.empty()) {
+                            fail(400, "chunked must be the final Transfer-Encoding");
+                            return false;
+                        }
+                        if (! iequals(coding, "chunked")) {
+                            fail(501, "Unsupported Transfer-Encoding");
+                            return false;
+                        }
+                        last_coding = coding;
+                    }
+                }
+                else if (iequals(name, "Expect")) {
+                    expect_continue_ = iequals(value, "100-continue");
                 }
-                packageList[pkgInd] = pkgObj;
             }
 
-            result["code"] = 200;
-            result["msg"] = "success";
-            result["packageTotal"] = packageTotal;
-            result["classTotal"] = classTotal;
-            result["methodTotal"] = methodTotal;
-            result["packageList"] = packageList;
-        } catch (const nlohmann::json::parse_error& ex) {
-            std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const nlohmann::json::type_error& ex) {
-            std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const nlohmann::json::other_error& ex) {
-            std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const std::exception& e) {
-            result = new_err_result(e);
+            if (has_encoding && has_length) {
+                fail(400, "Content-Length with Transfer-Encoding");
+                return false;
+            }
+            if (has_encoding && last_coding.empty()) {
+                fail(400, "Invalid Transfer-Encoding");
+                return false;
+            }
+
+            chunked_ = has_encoding;
+            if (! has_length) {
+                content_length_ = 0;
+            }
+            return true;
         }
 
-        return result;
-    }
+        std::string buffer_;
+        size_t size_ = 0; // buffer_ 中有效数据的字节数
+        size_t pos_ = 0; // 已解析到的位置
+        State state_ = HEADERS;
+
+        Range method_{};
+        Range path_{};
+        Range version_{};
+        std::vector<std::pair<Range, Range>> headers_;
+        size_t header_end_ = 0;
+        size_t content_length_ = 0;
+        size_t chunk_remaining_ = 0;
+        std::string decoded_;
+        bool chunked_ = false;
+        bool expect_continue_ = false;
+        bool continue_ = false;
+
+        int error_status_ = 0;
+        std::string error_;
+    };
 
-    static nlohmann::json list_str(std::string& str) {
-        nlohmann::json result;
-        json j;
-        try {
-            j = json::parse(str);
-        } catch (const nlohmann::json::parse_error& e) {
-            result = new_err_result(e);
-        } catch (const nlohmann::json::type_error& e) {
-            result = new_err_result(e);
-        } catch (const nlohmann::json::other_error& e) {
-            result = new_err_result(e);
-        } catch (const std::exception& e) {
-            result = new_err_result(e);
+    static const char* http_status_text(int status) {
+        switch (status) {
+            case 100: return "Continue";
+            case 200: return "OK";
+            case 301: return "Moved Permanently";
+            case 304: return "Not Modified";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 503: return "Service Unavailable";
+            default: return "OK";
         }
+    }
 
-        if (! result.empty()) {
-            result["code"] = 400;
-            return result;
-        }
+    // 请求无法解析时的响应，发送后关闭连接
+    static HttpResponse http_error_response(int status, const std::string& msg) {
+        HttpResponse response;
+        response.body = new_err_result(status, msg).dump();
+        std::string &head = response.head;
+        head.append("HTTP/1.1 ").append(std::to_string(status)).append(" ").append(http_status_text(status)).append("\r\n");
+        head.append("Content-Type: application/json\r\n");
+        head.append("Content-Length: ").append(std::to_string(response.body.size())).append("\r\n");
+        head.append("Connection: close\r\n");
+        head.append("\r\n");
+        return response;
+    }
 
-        return list_json(j);
+    static const std::string HTTP_CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
+
+    // 长连接空闲超时秒数，超时后关闭连接
+    static int SERVER_KEEP_ALIVE_TIMEOUT = 5;
+
+    // 响应发送停滞超时秒数，对端超过这个时间不读取时关闭连接
+    static int SERVER_WRITE_TIMEOUT = 5;
+    // 单个请求从收到第一个字节起必须在这个秒数内收完，否则关闭连接；
+    // 与空闲超时分开计算，逐字节慢速发送请求头或请求体也不能一直占用连接
+    static int SERVER_REQUEST_TIMEOUT = 30;
+    // 单个长连接最多处理的请求数，达到后回复 Connection: close 并关闭
+    static int SERVER_KEEP_ALIVE_MAX = 1000;
+
+    // /metrics 统计的路由，其它路径都计入 other
+    static const char* const METRIC_ROUTES[] = {"/method/invoke", "/method/invoke/batch", "/method/list", "/coverage", "/metrics", "other"};
+    static constexpr size_t METRIC_ROUTE_COUNT = sizeof(METRIC_ROUTES) / sizeof(METRIC_ROUTES[0]);
+    static CallMetrics ROUTE_METRICS[METRIC_ROUTE_COUNT];
+
+    // 当前打开的客户端连接数
+    static std::atomic<int64_t> SERVER_ACTIVE_CONNECTIONS{0};
+
+    static size_t metric_route(std::string_view path) {
+        if (path.substr(0, 10) == "/coverage/" || path == "/coverage") {
+            return 3;
+        }
+        for (size_t i = 0; i < METRIC_ROUTE_COUNT - 1; ++i) {
+            if (path == METRIC_ROUTES[i]) {
+                return i;
+            }
+        }
+        return METRIC_ROUTE_COUNT - 1;
     }
 
+    // Prometheus 标签值转义
+    static std::string metric_label(std::string_view value) {
+        std::string s;
+        s.reserve(value.size());
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                s += '\\';
+                s += c;
+            } else if (c == '\n') {
+                s += "\\n";
+            } else {
+                s += c;
+            }
+        }
+        return s;
+    }
 
+    // 按 Prometheus 文本格式输出路由、函数的调用次数、错误数、耗时直方图，以及工作线程与连接状态
+    static std::string metrics_text() {
+        std::ostringstream out;
 
-    static nlohmann::json invoke_json(nlohmann::json j) {
-        nlohmann::json result;
+        out << "# HELP unitauto_http_requests_total HTTP requests handled, by route.\n";
+        out << "# TYPE unitauto_http_requests_total counter\n";
+        for (size_t i = 0; i < METRIC_ROUTE_COUNT; ++i) {
+            out << "unitauto_http_requests_total{route=\"" << METRIC_ROUTES[i] << "\"} " << ROUTE_METRICS[i].total.load() << "\n";
+        }
+        out << "# HELP unitauto_http_request_errors_total HTTP requests answered with an error status or a non-200 code, by route.\n";
+        out << "# TYPE unitauto_http_request_errors_total counter\n";
+        for (size_t i = 0; i < METRIC_ROUTE_COUNT; ++i) {
+            out << "unitauto_http_request_errors_total{route=\"" << METRIC_ROUTES[i] << "\"} " << ROUTE_METRICS[i].errors.load() << "\n";
+        }
+        out << "# HELP unitauto_http_request_duration_seconds Time spent handling HTTP requests, by route.\n";
+        out << "# TYPE unitauto_http_request_duration_seconds histogram\n";
+        for (size_t i = 0; i < METRIC_ROUTE_COUNT; ++i) {
+            ROUTE_METRICS[i].latency.write(out, "unitauto_http_request_duration_seconds", std::string("route=\"") + METRIC_ROUTES[i] + "\"");
+        }
 
-        try {
-            json method = j["method"];
-            std::string mtd = method.empty() ? "" : method.get<std::string>();
-            if (mtd.empty()) {
-                throw std::runtime_error("method cannot be empty! should be a string!");
+        // 只输出被调用过的函数，先在锁内复制出来
+        std::vector<std::pair<std::string, std::shared_ptr<CallMetrics>>> funcs;
+        {
+            std::shared_lock<std::shared_mutex> lock(REGISTRY_MUTEX);
+            for (const auto& kv : FUNC_MAP) {
+                if (kv.second.metrics->total.load(std::memory_order_relaxed) > 0) {
+                    funcs.emplace_back(kv.second.name, kv.second.metrics);
+                }
             }
+        }
+        std::sort(funcs.begin(), funcs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
 
-            json package = j["package"];
-            std::string pkg = package.empty() ? "" : package.get<std::string>();
+        out << "# HELP unitauto_invocations_total Function invocations through /method/invoke, by function path.\n";
+        out << "# TYPE unitauto_invocations_total counter\n";
+        for (const auto& f : funcs) {
+            out << "unitauto_invocations_total{path=\"" << metric_label(f.first) << "\"} " << f.second->total.load() << "\n";
+        }
+        out << "# HELP unitauto_invocation_errors_total Function invocations that threw, by function path.\n";
+        out << "# TYPE unitauto_invocation_errors_total counter\n";
+        for (const auto& f : funcs) {
+            out << "unitauto_invocation_errors_total{path=\"" << metric_label(f.first) << "\"} " << f.second->errors.load() << "\n";
+        }
+        out << "# HELP unitauto_invocation_duration_seconds Time spent in the invoked function, by function path.\n";
+        out << "# TYPE unitauto_invocation_duration_seconds histogram\n";
+        for (const auto& f : funcs) {
+            f.second->latency.write(out, "unitauto_invocation_duration_seconds", "path=\"" + metric_label(f.first) + "\"");
+        }
 
-            json clazz = j["class"];
-            std::string cls = clazz.empty() ? "" : clazz.get<std::string>();
+        WorkerPool* pool = SERVER_POOL;
+        out << "# HELP unitauto_worker_threads Worker threads in the pool.\n";
+        out << "# TYPE unitauto_worker_threads gauge\n";
+        out << "unitauto_worker_threads " << (pool == nullptr ? 0 : pool->thread_count()) << "\n";
+        out << "# HELP unitauto_worker_busy Worker threads currently running a task.\n";
+        out << "# TYPE unitauto_worker_busy gauge\n";
+        out << "unitauto_worker_busy " << (pool == nullptr ? 0 : pool->busy_count()) << "\n";
+        out << "# HELP unitauto_worker_queue_depth Tasks waiting for a worker thread.\n";
+        out << "# TYPE unitauto_worker_queue_depth gauge\n";
+        out << "unitauto_worker_queue_depth " << (pool == nullptr ? 0 : pool->queue_size()) << "\n";
+        out << "# HELP unitauto_active_connections Open client connections.\n";
+        out << "# TYPE unitauto_active_connections gauge\n";
+        out << "unitauto_active_connections " << SERVER_ACTIVE_CONNECTIONS.load() << "\n";
+
+        return out.str();
+    }
 
-            std::string path = mtd;
-            if (! cls.empty()) {
-                path = cls + "." + path;
+    // 媒体类型(不含参数)对应的编码，不支持时返回 false
+    static bool media_format(std::string_view type, BodyFormat &format) {
+        if (iequals(type, "application/json")) {
+            format = FORMAT_JSON;
+        } else if (iequals(type, "application/msgpack") || iequals(type, "application/x-msgpack")) {
+            format = FORMAT_MSGPACK;
+        } else if (iequals(type, "application/cbor")) {
+            format = FORMAT_CBOR;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // 按 Content-Type 判断请求体编码，不是 MessagePack/CBOR 时按 JSON 处理
+    static BodyFormat body_format(std::string_view content_type) {
+        BodyFormat format = FORMAT_JSON;
+        media_format(trim_view(content_type.substr(0, content_type.find(';'))), format);
+        return format;
+    }
+
+    // 按 Accept 选择响应体编码：每种编码取最具体的匹配范围(精确类型 > application/* > */*)的 q 值，
+    // 选 q 最大的，相同时优先 def；没有 Accept 或都不接受时返回 def
+    static BodyFormat accept_format(std::string_view accept, BodyFormat def) {
+        double q[] = {-1, -1, -1};
+        int level[] = {-1, -1, -1};
+        while (! accept.empty()) {
+            auto comma = accept.find(',');
+            std::string_view item = accept.substr(0, comma);
+            accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+
+            auto semi = item.find(';');
+            std::string_view type = trim_view(item.substr(0, semi));
+            double weight = 1;
+            while (semi != std::string_view::npos) {
+                item = item.substr(semi + 1);
+                semi = item.find(';');
+                std::string_view param = trim_view(item.substr(0, semi));
+                if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    weight = std::strtod(std::string(param.substr(2)).c_str(), nullptr);
+                }
             }
-            if (! pkg.empty()) {
-                path = pkg + "." + path;
+
+            BodyFormat format;
+            if (media_format(type, format)) {
+                if (level[format] < 2) {
+                    level[format] = 2;
+                    q[format] = weight;
+                }
+            } else if (type == "*/*" || iequals(type, "application/*")) {
+                int l = type == "*/*" ? 0 : 1;
+                for (int f = FORMAT_JSON; f <= FORMAT_CBOR; f ++) {
+                    if (level[f] < l) {
+                        level[f] = l;
+                        q[f] = weight;
+                    }
+                }
             }
+        }
+
+        BodyFormat best = def;
+        for (int f = FORMAT_JSON; f <= FORMAT_CBOR; f ++) {
+            if (q[f] > q[best]) {
+                best = static_cast<BodyFormat>(f);
+            }
+        }
+        return q[best] > 0 ? best : def;
+    }
 
-            json clsArgs = j["classArgs"];
+    // 处理一个完整的 HTTP 请求并生成完整的 HTTP 响应；
+    // keep_alive 传入服务端是否允许保持连接，传出本次响应后是否保持连接
+    static HttpResponse handle_http(const HttpRequest& request, bool& keep_alive) {
+        std::string_view method = request.method;
+        std::string_view path = request.path;
+        std::string_view http_version = request.version;
+        std::string_view json_data = request.body;
+        std::string host = std::string(request.header("Origin"));
+        std::string_view connection = request.header("Connection");
+
+        // HTTP/1.1 默认保持连接，HTTP/1.0 需要显式 Connection: keep-alive
+        if (icontains(connection, "close")) {
+            keep_alive = false;
+        } else if (http_version != "HTTP/1.1" && ! icontains(connection, "keep-alive")) {
+            keep_alive = false;
+        }
 
-            json thiz = j["this"];
+        // 请求体按 Content-Type 解码，响应体按 Accept 编码，Accept 中没有指定时与请求一致
+        BodyFormat request_format = body_format(request.header("Content-Type"));
+        BodyFormat response_format = accept_format(request.header("Accept"), request_format);
+        ContentEncoding encoding = accept_encoding(request.header("Accept-Encoding"));
 
-            json is_static = j["static"];
+        long long handle_start = current_time_millis();
+        bool failed = false;
 
-            bool is_sttc;
-            bool is_sttc1 = (! is_static.empty()) && is_static.get<bool>();
-            bool is_sttc2 = path.at(0) != '&' && thiz.empty() && clsArgs.empty();
+        int status = 200;
+        std::string location = "";
+        std::string etag = "";
+        std::string content_type = "application/json";
+        bool vary_accept = false; // 响应体编码按 Accept 协商的接口
 
-            if (is_static.empty()) {
-                is_sttc = is_sttc2 && (cls.empty() || cls.at(0) < 'A' || cls.at(0) > 'Z');
+        Value stream_ret;
+
+        // 处理数据并生成响应 JSON
+        std::string response_json = new_ok_result().dump();
+        bool isOpt = method == "options" || method == "OPTIONS";
+        bool isPost = method == "post" || method == "POST";
+        bool isGet = method == "get" || method == "GET";
+        bool isGetOrPost = isGet || isPost;
+
+        if (isGet && path == "/metrics") {
+            content_type = "text/plain; version=0.0.4; charset=utf-8";
+            response_json = metrics_text();
+        }
+        else if (isGetOrPost && path == "/coverage/start") {
+            start_coverage();
+            json result;
+            result = new_ok_result();
+            result["msg"] = "Coverage collection started";
+            response_json = result.dump();
+        }
+        else if (isGetOrPost && path == "/coverage/stop") {
+            stop_coverage();
+            json result;
+            result = new_ok_result();
+            result["msg"] = "Coverage collection stopped and report generated";
+            result["url"] = "/coverage_report/index.html";
+            result["html"] = read_file("coverage_report/index.html");
+            result["json"] = read_file("coverage_filtered.info");
+            response_json = result.dump();
+        }
+        else if (isGetOrPost && path == "/coverage/save") {
+            generate_coverage_report();
+        }
+        else if (isGetOrPost && path == "/coverage/report") {
+            json result;
+            result = new_ok_result();
+            result["msg"] = "Coverage generated";
+            result["url"] = "/coverage/index.html";
+            result["html"] = read_file("coverage/index.html");
+            result["json"] = read_file("coverage_filtered.info");
+            response_json = result.dump();
+        }
+        else if (isGet && (path == "/coverage" || path == "/coverage/index.html")) {
+            status = 301;
+            location = "Location: " + host + "/coverage/index.html";
+        }
+        else if (isPost && path == "/method/list" && request_format == FORMAT_JSON && response_format == FORMAT_JSON
+            && (trim_view(json_data).empty() || trim_view(json_data) == "{}")) {
+            // 不带过滤条件时直接用缓存的完整列表，客户端带上协商出的编码对应的 ETag 时返回 304
+            auto cached = list_dump(etag);
+            vary_accept = true;
+            if (cached->size() < HTTP_COMPRESS_MIN_SIZE) {
+                encoding = ENCODING_IDENTITY;
             }
-            else if (is_sttc1 && is_sttc1 != is_sttc2) {
-                throw std::runtime_error("static cannot be true while method path starts with '&' or this/classArgs is not empty!");
+            if (request.header("If-None-Match") == encoded_etag(etag, encoding)) {
+                status = 304;
+                response_json.clear();
+            } else {
+                response_json = *cached;
+            }
+        }
+        else if (isPost) {
+            nlohmann::json result;
+            vary_accept = path.rfind("/method/", 0) == 0;
+            if (path == "/method/invoke") {
+                // HTTP/1.1 请求带 "stream": true 时，std::vector 返回值按 chunked 编码逐个元素写出，只支持 JSON
+                bool can_stream = http_version == "HTTP/1.1" && response_format == FORMAT_JSON;
+                result = invoke_str(json_data, can_stream ? &stream_ret : nullptr, request_format);
+            }
+            else if (path == "/method/invoke/batch") {
+                result = invoke_batch_str(json_data, request_format);
+            }
+            else if (path == "/method/list") {
+                result = list_str(json_data, request_format);
             }
             else {
-                is_sttc = is_sttc1;
+                result = new_err_result(404, "Only support POST /method/invoke, POST /method/invoke/batch, POST /method/list, POST /coverage/save ！");
             }
 
-            json tt;
-            if (! is_sttc) {
-                tt = thiz["type"];
-                if (tt.empty()) {
-                    std::string t = (pkg.empty() ? "" : pkg + ".") + cls;
-                    thiz["type"] = tt = t;
+            auto code = result.is_object() ? result.find("code") : result.end();
+            failed = code != result.end() && *code != 200;
+
+            content_type = body_content_type(response_format);
+            response_json = dump_body(result, response_format);
+            if (! stream_ret.has_value() || failed) {
+                stream_ret = Value();
+            }
+        }
+        else if (! isOpt) {
+            failed = true;
+            response_json = R"({
+                "code": 400,
+                "msg": "Only support HTTP POST Method！"
+            })";
+        }
+
+        // 压缩响应体，304 及太小的响应体不压缩，流式响应在输出时逐块压缩
+        if (encoding != ENCODING_IDENTITY && status != 304 && ! stream_ret.has_value()) {
+            std::string compressed;
+            if (response_json.size() >= HTTP_COMPRESS_MIN_SIZE && compress_body(response_json, encoding, compressed)) {
+                response_json = std::move(compressed);
+            } else {
+                encoding = ENCODING_IDENTITY;
+            }
+        }
+
+        // 构建 HTTP 响应头，响应体直接移动过去
+        HttpResponse response;
+        std::string &head = response.head;
+        head.reserve(512);
+        head.append("HTTP/1.1 ").append(std::to_string(status)).append(" ").append(http_status_text(status)).append("\r\n");
+        head.append("Content-Type: ").append(content_type).append("\r\n");
+        head.append("Access-Control-Allow-Origin: ").append(host).append("\r\n");
+        head.append("Access-Control-Allow-Credentials: true\r\n");
+        head.append("Access-Control-Allow-Headers: content-type, if-none-match\r\n");
+        head.append("Access-Control-Expose-Headers: ETag\r\n");
+        head.append("Access-Control-Request-Method: POST\r\n");
+        if (encoding != ENCODING_IDENTITY) {
+            head.append("Content-Encoding: ").append(encoding == ENCODING_GZIP ? "gzip" : "deflate").append("\r\n");
+        }
+        if (vary_accept) {
+            head.append("Vary: Accept, Accept-Encoding\r\n");
+        } else if (encoding != ENCODING_IDENTITY) {
+            head.append("Vary: Accept-Encoding\r\n");
+        }
+        if (stream_ret.has_value()) {
+            head.append("Transfer-Encoding: chunked\r\n");
+        } else if (status != 304) {
+            head.append("Content-Length: ").append(std::to_string(response_json.size())).append("\r\n");
+        }
+        if (! etag.empty()) {
+            head.append("ETag: ").append(encoded_etag(etag, encoding)).append("\r\n");
+        }
+        if (location.length() > 0) {
+            head.append(location).append("\r\n");
+        }
+        if (keep_alive) {
+            head.append("Connection: keep-alive\r\n");
+            head.append("Keep-Alive: timeout=").append(std::to_string(SERVER_KEEP_ALIVE_TIMEOUT)).append("\r\n");
+        } else {
+            head.append("Connection: close\r\n");
+        }
+        head.append("\r\n");
+        if (stream_ret.has_value()) {
+            response.stream = stream_result(std::move(response_json), std::move(stream_ret), encoding);
+        } else {
+            response.body = std::move(response_json);
+        }
+
+        ROUTE_METRICS[metric_route(path)].observe(current_time_millis() - handle_start, failed || status >= 400);
+
+        return response;
+    }
+
+    // 阻塞处理一个连接，非 Linux 平台使用。与 serve_epoll 一样支持 HTTP/1.1 长连接和管线化，
+    // 同一连接上的请求按顺序逐个处理；等下一个请求超过 SERVER_KEEP_ALIVE_TIMEOUT 秒，
+    // 或一个请求超过 SERVER_REQUEST_TIMEOUT 秒还没收完时关闭。连接存活期间一直占用一个工作线程
+    inline void handle_request(int client_socket) {
+        using clock = std::chrono::steady_clock;
+        SERVER_ACTIVE_CONNECTIONS ++;
+        // 对端不读取时发送最多阻塞 SERVER_WRITE_TIMEOUT 秒，超时返回 EAGAIN，此时队列不为空，按出错处理
+        timeval send_timeout{SERVER_WRITE_TIMEOUT, 0};
+        setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        auto idle_timeout = std::chrono::seconds(SERVER_KEEP_ALIVE_TIMEOUT);
+        auto request_timeout = std::chrono::seconds(SERVER_REQUEST_TIMEOUT);
+
+        HttpParser parser;
+        int requests = 0;
+        bool keep_alive = true;
+        while (keep_alive) {
+            // 管线化时缓冲区中可能已有下一个请求的一部分
+            bool reading = parser.buffered() > 0;
+            auto request_start = clock::now();
+
+            HttpParser::Status st = HttpParser::NEED_MORE;
+            while (true) {
+                st = parser.parse();
+                if (parser.take_continue()) {
+                    send_all(client_socket, HTTP_CONTINUE_RESPONSE.data(), HTTP_CONTINUE_RESPONSE.size());
+                }
+                if (st != HttpParser::NEED_MORE) {
+                    break;
                 }
 
-                std::string type = tt.get<std::string>();
-                json value = thiz["value"];
-                // this_ = json_2_obj(value, type);
-            } else if (! (thiz.empty() && clsArgs.empty())) {
-                throw std::runtime_error("static: true 时，this 和 classArgs 都必须不传或为空！");
+                // 还没收到请求时按空闲超时等待，收到一部分后按请求剩余的时间等待
+                auto now = clock::now();
+                if (! reading && parser.buffered() > 0) {
+                    reading = true;
+                    request_start = now;
+                }
+                auto wait = reading ? request_timeout - (now - request_start) : clock::duration(idle_timeout);
+                auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+                if (wait_us <= 0) {
+                    break;
+                }
+                timeval recv_timeout{static_cast<time_t>(wait_us / 1000000), static_cast<suseconds_t>(wait_us % 1000000)};
+                setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+
+                char* buffer = parser.prepare(16 * 1024);
+                ssize_t bytes_received = recv(client_socket, buffer, 16 * 1024, 0);
+                if (bytes_received < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (bytes_received <= 0) {
+                    break; // 对端关闭、超时或出错
+                }
+                parser.commit(bytes_received);
             }
 
-            nlohmann::json args_ = j["args"];
-            if (args_.empty()) {
-                args_ = j["methodArgs"];
+            if (st == HttpParser::ERROR) {
+                OutputQueue out;
+                out.push(http_error_response(parser.error_status(), parser.error()));
+                out.flush(client_socket);
+                break;
+            }
+            if (st != HttpParser::COMPLETE) {
+                break;
             }
 
-            std::vector<std::any> args;
-            json methodArgs;
-
-            for (int i = 0; i < args_.size(); ++i) {
-                auto arg = args_.at(i);
-                std::any a = json_to_any(arg);
-                // std::any a = static_cast<std::any>(arg);
-                args.push_back(a);
-
-                json ma;
-                std::string t;
+            HttpRequest request;
+            parser.take(request);
+            requests ++;
+            keep_alive = requests < SERVER_KEEP_ALIVE_MAX;
+
+            OutputQueue out;
+            HttpResponse response = handle_http(request, keep_alive);
+            auto stream = std::move(response.stream);
+            out.push(std::move(response));
+            bool ok = out.flush(client_socket) && out.empty();
+            if (ok && stream) {
                 try {
-                    t = get_type(a);
-                    if (t.empty()) {
-                        t = arg.type_name();
-                    }
-                    ma["type"] = t;
+                    ok = stream([&out, client_socket](std::string &&chunk) {
+                        out.push(std::move(chunk));
+                        return out.flush(client_socket) && out.empty();
+                    });
                 } catch (const std::exception& e) {
-                    std::cout << "invoke_json  try { \n auto type_cs = typeid(a).name();... \n } catch (const std::exception& e) = " << e.what() << " >> ma[\"type\"] = arg.type_name();" << std::endl;
-                    t = arg.type_name();
-                    ma["type"] = t;
-                } catch (const nlohmann::json::parse_error& ex) {
-                    std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-                } catch (const nlohmann::json::type_error& ex) {
-                    std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-                } catch (const nlohmann::json::other_error& ex) {
-                    std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
+                    log_error("Server stream response error: ", e.what());
+                    ok = false;
                 }
+            }
+            // 响应没有完整发出时只能关闭连接
+            keep_alive = keep_alive && ok;
+        }
 
-                try {
-                    ma["value"] = any_to_json(a, ma["type"].get<std::string>());
-                } catch (const std::exception& e) {
-                    std::cout << "invoke_json  try { \n ma[\"value\"] = any_to_json(a); \n } catch (const std::exception& e) = " << e.what() << " >> ma[\"value\"] = arg;" << std::endl;
-                    ma["value"] = arg;
-                } catch (const nlohmann::json::parse_error& ex) {
-                    std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-                } catch (const nlohmann::json::type_error& ex) {
-                    std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-                } catch (const nlohmann::json::other_error& ex) {
-                    std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
-                }
+        close(client_socket);
+        SERVER_ACTIVE_CONNECTIONS --;
+    }
 
-                methodArgs.push_back(ma);
-            }
+    static std::atomic<bool> running = true;
+    static void handle_signal(int signal) {
+        if (signal == SIGINT) {
+            running = false;
+        }
+    }
 
-            long long start = current_time_millis();
-            std::any ret = invoke_method(thiz, path, args);
-            long long end = current_time_millis();
+    // 用 select 等待新连接，每个连接交给工作线程阻塞读写(见 handle_request)，非 Linux 平台使用
+    static int serve_select(int server_socket, WorkerPool& pool) {
+        fd_set read_fds;
+        int max_fd = server_socket;
 
-            result = new_ok_result();
-            std::ostringstream time_str;
-            time_str << start << "|" << (end - start) << "|" << end;
-            result["time:start|duration|end"] = time_str.str();
+        while (running) {
+            FD_ZERO(&read_fds);
+            FD_SET(server_socket, &read_fds);
 
-            std::string type = get_type(ret);
-            if (! type.empty()) {
-                result["type"] = type;  // type_cs;
+            struct timeval timeout;
+            timeout.tv_sec = 1;
+            timeout.tv_usec = 0;
 
-                json v = any_to_json(ret, type);
-                result["return"] = v;
+            int activity = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+            if (activity < 0 && errno != EINTR) {
+                log_error("Server select error: ", strerror(errno));
+                return -1;
             }
 
-            if (! is_sttc) {
-                std::string type = tt.get<std::string>();
-                result["this"] = any_to_json(thiz, type);
+            if (activity > 0 && FD_ISSET(server_socket, &read_fds)) {
+                int client_socket = accept(server_socket, nullptr, nullptr);
+                if (client_socket >= 0) {
+                    // 队列满时不阻塞等待，直接返回 503 并关闭连接
+                    if (! pool.try_submit([client_socket] { handle_request(client_socket); })) {
+                        HttpResponse response = http_error_response(503, "Server is busy, please retry later!");
+                        OutputQueue out;
+                        out.push(std::move(response));
+                        out.flush(client_socket);
+                        close(client_socket);
+                    }
+                } else {
+                    log_error("Server accept error: ", strerror(errno));
+                }
             }
-
-            result["methodArgs"] = methodArgs; // any_to_json(args);
-        } catch (const nlohmann::json::parse_error& ex) {
-            std::cout << "nlohmann::json::parse_error at byte " << ex.byte << ": " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const nlohmann::json::type_error& ex) {
-            std::cout << "nlohmann::json::type_error " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const nlohmann::json::other_error& ex) {
-            std::cout << "nlohmann::json::other_error " << ex.what() << std::endl;
-            result = new_err_result(ex);
-        } catch (const std::exception& e) {
-            result = new_err_result(e);
         }
 
-        return result;
-    }
 
+        return 0;
+    }
 
-    static nlohmann::json invoke_str(std::string& str) {
-        nlohmann::json result;
-        json j;
-        try {
-            j = json::parse(str);
-        } catch (const nlohmann::json::parse_error& e) {
-            result = new_err_result(e);
-        } catch (const nlohmann::json::type_error& e) {
-            result = new_err_result(e);
-        } catch (const nlohmann::json::other_error& e) {
-            result = new_err_result(e);
-        } catch (const std::exception& e) {
-            result = new_err_result(e);
+#ifdef __linux__
+    // 工作线程流式产生的响应数据交给事件循环发送，积压超过 HTTP_STREAM_BUFFER_SIZE 时工作线程等待，连接关闭时取消
+    struct StreamChannel {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t pending = 0;
+        bool cancelled = false;
+
+        // 工作线程调用，等积压降下来再记入 n 字节，返回 false 表示已取消；
+        // 对端超过 SERVER_WRITE_TIMEOUT 秒不读取时取消，不让工作线程一直等下去
+        bool reserve(size_t n) {
+            std::unique_lock<std::mutex> lock(mutex);
+            bool ready = cv.wait_for(lock, std::chrono::seconds(SERVER_WRITE_TIMEOUT),
+                [this] { return cancelled || pending < HTTP_STREAM_BUFFER_SIZE; });
+            if (! ready) {
+                cancelled = true;
+            }
+            if (cancelled) {
+                return false;
+            }
+            pending += n;
+            return true;
         }
 
-        if (! result.empty()) {
-            result["code"] = 400;
-            return result;
+        // 事件循环调用，已交给的数据都发送完了
+        void drained() {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = 0;
+            cv.notify_all();
         }
 
-        return invoke_json(j);
-    }
+        void cancel() {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            cv.notify_all();
+        }
+    };
 
+    // 单个连接的读写状态，只在事件循环线程中访问
+    struct Connection {
+        int fd = -1;
+        HttpParser parser; // 已读取但还未处理的请求数据
+        OutputQueue out; // 还未发送完的响应数据
+        bool busy = false; // 是否有请求正在工作线程中处理
+        bool peer_closed = false; // 对端是否已关闭写端
+        bool close_after_write = false; // 响应发送完后关闭连接
+        std::shared_ptr<StreamChannel> stream; // 正在流式输出的响应
+        int requests = 0; // 已处理的请求数
+        std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
+        bool reading = false; // 是否有还没收完的请求
+        std::chrono::steady_clock::time_point request_start; // 还没收完的请求开始等待的时间
+    };
 
-    // 生成覆盖率报告
-    void generate_coverage_report() {
-        // 生成覆盖率数据
-        system("lcov --capture --directory . --output-file coverage.info");
-        // 过滤掉不需要的数据
-        system("lcov --remove coverage.info '/usr/*' '*/tests/*' '*/external/*' --output-file coverage_filtered.info");
-        // 生成 HTML 报告
-        system("genhtml coverage_filtered.info --output-directory coverage");
-    }
+    // 工作线程处理完的响应，交回事件循环线程发送
+    struct Completion {
+        uint64_t id;
+        HttpResponse response;
+        bool keep_alive;
+        std::shared_ptr<StreamChannel> stream; // 不为空时响应还没输出完，连接保持忙碌
+    };
 
-    static bool coverage_enabled = false;
+    // 用 epoll(边缘触发) + 非阻塞 socket 处理所有连接的读写，只有完整的请求才交给工作线程处理，
+    // 慢速发送请求的客户端不会阻塞其它连接；工作线程通过 eventfd 通知事件循环发送响应。
+    // 支持 HTTP/1.1 长连接和管线化：同一连接上的请求按顺序逐个处理，响应顺序与请求一致
+    static int serve_epoll(int server_socket, WorkerPool& pool) {
+        static const uint64_t LISTEN_ID = 0;
+        static const uint64_t EVENT_ID = 1;
+
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        int evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epfd < 0 || evfd < 0) {
+            log_error("Server epoll/eventfd error: ", strerror(errno));
+            if (epfd >= 0) {
+                close(epfd);
+            }
+            if (evfd >= 0) {
+                close(evfd);
+            }
+            return -1;
+        }
 
-    // 清除之前的覆盖率数据
-    void reset_coverage_data() {
-        system("lcov --directory . --zerocounters");
-    }
+        fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL, 0) | O_NONBLOCK);
 
-    // 启动覆盖率统计
-    void start_coverage() {
-        if (! coverage_enabled) {
-            reset_coverage_data();
-            coverage_enabled = true;
-            std::cout << "Coverage collection started." << std::endl;
-        }
-    }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u64 = LISTEN_ID;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, server_socket, &ev);
+        ev.data.u64 = EVENT_ID;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev);
 
-    // 停止覆盖率统计并生成报告
-    void stop_coverage() {
-        if (coverage_enabled) {
-            coverage_enabled = false;
-            std::cout << "Coverage collection stopped." << std::endl;
-            generate_coverage_report();
-        }
-    }
+        uint64_t next_id = EVENT_ID + 1;
+        std::unordered_map<uint64_t, Connection> conns;
 
-    // 读取文件内容
-    std::string read_file(const std::string& file_path) {
-        std::ifstream file(file_path);
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    }
+        std::mutex done_mutex;
+        std::vector<Completion> done;
 
-    // 处理请求并生成响应
-    inline void handle_request(int client_socket) {
-        char buffer[1024];
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
-        if (bytes_received > 0) {
-            std::string request(buffer, bytes_received);
+        auto close_conn = [&](uint64_t id) {
+            auto it = conns.find(id);
+            if (it == conns.end()) {
+                return;
+            }
+            epoll_ctl(epfd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+            close(it->second.fd);
+            if (it->second.stream) {
+                it->second.stream->cancel();
+            }
+            conns.erase(it);
+            SERVER_ACTIVE_CONNECTIONS --;
+        };
 
-            // 简单解析 HTTP 请求
-            std::istringstream request_stream(request);
-            std::string method, path, http_version;
-            request_stream >> method >> path >> http_version;
+        // 缓冲区中已有完整请求时交给工作线程处理，一个连接同时只处理一个请求
+        auto dispatch = [&](uint64_t id, Connection& c) {
+            if (c.busy) {
+                return;
+            }
 
-            // 解析 JSON 数据（假设数据在请求体中）
-            std::string json_data;
-            // std::getline(request_stream, json_data); // 跳过空行
-            // std::getline(request_stream, json_data);
+            HttpParser::Status st = c.parser.parse();
+            if (c.parser.take_continue()) {
+                c.out.push(HTTP_CONTINUE_RESPONSE);
+            }
+            if (st == HttpParser::NEED_MORE) {
+                // 请求收到一部分时开始计时，之后再收到数据也不重新计时
+                if (! c.reading && c.parser.buffered() > 0) {
+                    c.reading = true;
+                    c.request_start = std::chrono::steady_clock::now();
+                }
+                return;
+            }
+            c.reading = false;
+            if (st == HttpParser::ERROR) {
+                c.out.push(http_error_response(c.parser.error_status(), c.parser.error()));
+                c.close_after_write = true;
+                return;
+            }
 
-            bool first = true;
-            bool start = false;
-            std::string host = "";
-            int len = static_cast<int>(strlen("Origin:"));
-
-            while (! request_stream.eof()) {
-                std::string line;
-                std::getline(request_stream, line); // 跳过空行
-                std::string pre = line.length() < len ? "" : line.substr(0, len);
-                if (host.empty() && (pre == "Origin:" || pre == "origin:")) {
-                    host = line.substr(len + 1);
-                }
-
-                if (start) {
-                    json_data += "\n" + line;
-                } else if (! first) {
-                    line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
-                    if (line.empty()) {
-                        start = true;
+            // 缓冲区直接移交给请求对象，工作线程处理期间事件循环可以继续往解析器里读后续数据
+            auto request = std::make_shared<HttpRequest>();
+            c.parser.take(*request);
+            c.busy = true;
+            c.requests ++;
+            bool keep_alive = c.requests < SERVER_KEEP_ALIVE_MAX;
+
+            // 事件循环线程不能阻塞等待队列空位，队列满时直接返回 503 并关闭连接
+            bool submitted = pool.try_submit([id, request, keep_alive, &done_mutex, &done, evfd] {
+                bool ka = keep_alive;
+                HttpResponse response = handle_http(*request, ka);
+                auto stream = std::move(response.stream);
+                auto channel = stream ? std::make_shared<StreamChannel>() : nullptr;
+
+                auto complete = [&](HttpResponse &&r, std::shared_ptr<StreamChannel> more) {
+                    {
+                        std::lock_guard<std::mutex> lock(done_mutex);
+                        done.push_back({id, std::move(r), ka, std::move(more)});
                     }
-                    else if (line.substr(0, 1) == "{") {
-                        start = true;
-                        json_data += line;
+                    uint64_t one = 1;
+                    ssize_t w = write(evfd, &one, sizeof(one));
+                    (void) w;
+                };
+
+                complete(std::move(response), channel);
+                if (stream) {
+                    bool ok = false;
+                    try {
+                        ok = stream([&](std::string &&chunk) {
+                            if (! channel->reserve(chunk.size())) {
+                                return false;
+                            }
+                            HttpResponse r;
+                            r.body = std::move(chunk);
+                            complete(std::move(r), channel);
+                            return true;
+                        });
+                    } catch (const std::exception& e) {
+                        log_error("Server stream response error: ", e.what());
+                    } catch (...) {
+                        log_error("Server stream response error: unknown exception");
                     }
+                    // 输出中断时响应不完整，只能关闭连接；无论成功与否都要结束流，让连接退出忙碌状态
+                    ka = ka && ok;
+                    complete(HttpResponse(), nullptr);
                 }
+            });
 
-                first = false;
+            if (! submitted) {
+                log_warn("Server worker queue is full, reject request with 503");
+                c.busy = false;
+                c.out.push(http_error_response(503, "Server is busy, please retry later!"));
+                c.close_after_write = true;
+            }
+        };
+
+        // 响应发送完后，需要关闭的连接关闭，否则继续处理管线中的下一个请求
+        auto finish = [&](uint64_t id, Connection& c) {
+            // 流式输出中：尽量发送，发完后让工作线程继续产生
+            if (c.busy && c.stream && ! c.out.empty()) {
+                if (! c.out.flush(c.fd)) {
+                    close_conn(id);
+                    return;
+                }
+                if (c.out.empty()) {
+                    c.stream->drained();
+                }
+                return;
             }
 
-            int status = 200;
-            std::string location = "";
+            while (! c.busy) {
+                if (! c.out.empty()) {
+                    if (! c.out.flush(c.fd)) {
+                        close_conn(id);
+                        return;
+                    }
+                    if (! c.out.empty()) {
+                        return; // 等 EPOLLOUT 再继续发送
+                    }
+                }
 
-            // 处理数据并生成响应 JSON
-            std::string response_json = new_ok_result().dump();
-;
-            bool isOpt = method == "options" || method == "OPTIONS";
-            bool isPost = method == "post" || method == "POST";
-            bool isGet = method == "get" || method == "GET";
-            bool isGetOrPost = isGet || isPost;
+                if (c.close_after_write) {
+                    close_conn(id);
+                    return;
+                }
 
-            if (isGetOrPost && path == "/coverage/start") {
-                start_coverage();
-                json result;
-                result = new_ok_result();
-                result["msg"] = "Coverage collection started";
-                response_json = result.dump();
-            }
-            else if (isGetOrPost && path == "/coverage/stop") {
-                stop_coverage();
-                json result;
-                result = new_ok_result();
-                result["msg"] = "Coverage collection stopped and report generated";
-                result["url"] = "/coverage_report/index.html";
-                result["html"] = read_file("coverage_report/index.html");
-                result["json"] = read_file("coverage_filtered.info");
-                response_json = result.dump();
-            }
-            else if (isGetOrPost && path == "/coverage/save") {
-                generate_coverage_report();
+                dispatch(id, c);
+                if (! c.busy && c.out.empty()) {
+                    if (c.peer_closed) {
+                        close_conn(id);
+                    }
+                    return;
+                }
             }
-            else if (isGetOrPost && path == "/coverage/report") {
-                json result;
-                result = new_ok_result();
-                result["msg"] = "Coverage generated";
-                result["url"] = "/coverage/index.html";
-                result["html"] = read_file("coverage/index.html");
-                result["json"] = read_file("coverage_filtered.info");
-                response_json = result.dump();
+        };
+
+        auto idle_timeout = std::chrono::seconds(SERVER_KEEP_ALIVE_TIMEOUT);
+        auto write_timeout = std::chrono::seconds(SERVER_WRITE_TIMEOUT);
+        auto request_timeout = std::chrono::seconds(SERVER_REQUEST_TIMEOUT);
+        auto last_sweep = std::chrono::steady_clock::now();
+
+        epoll_event events[256];
+        int ret = 0;
+
+        while (running) {
+            int n = epoll_wait(epfd, events, 256, 1000);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                log_error("Server epoll_wait error: ", strerror(errno));
+                ret = -1;
+                break;
             }
-            else if (isGet && (path == "/coverage" || path == "/coverage/index.html")) {
-                status = 301;
-                location = "Location: " + host + "/coverage/index.html";
+
+            // 每秒清理一次空闲超时、请求接收超时及发送停滞的连接
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_sweep >= std::chrono::seconds(1)) {
+                last_sweep = now;
+                std::vector<uint64_t> expired;
+                for (auto& kv : conns) {
+                    Connection& c = kv.second;
+                    if (! c.busy && c.out.empty() && now - c.last_active >= idle_timeout) {
+                        expired.push_back(kv.first);
+                    } else if (! c.busy && c.reading && now - c.request_start >= request_timeout) {
+                        // 请求一直收不完(慢速攻击)，收到数据刷新的 last_active 不影响这个期限
+                        expired.push_back(kv.first);
+                    } else if (c.out.stalled(now, write_timeout)) {
+                        // 对端不读取响应，关闭连接，流式输出中的工作线程随之取消
+                        expired.push_back(kv.first);
+                    }
+                }
+                for (auto cid : expired) {
+                    close_conn(cid);
+                }
             }
-            else if (isPost) {
-                nlohmann::json result;
-                if (path == "/method/invoke") {
-                    result = invoke_str(json_data);
+
+            for (int i = 0; i < n; ++i) {
+                uint64_t id = events[i].data.u64;
+                uint32_t flags = events[i].events;
+
+                if (id == LISTEN_ID) {
+                    while (true) {
+                        int client_socket = accept4(server_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                        if (client_socket < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                                log_error("Server accept error: ", strerror(errno));
+                            }
+                            break;
+                        }
+
+                        uint64_t cid = next_id++;
+                        conns[cid].fd = client_socket;
+                        SERVER_ACTIVE_CONNECTIONS ++;
+
+                        epoll_event cev{};
+                        cev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                        cev.data.u64 = cid;
+                        epoll_ctl(epfd, EPOLL_CTL_ADD, client_socket, &cev);
+                    }
+                    continue;
                 }
-                else if (path == "/method/list") {
-                    result = list_str(json_data);
+
+                if (id == EVENT_ID) {
+                    uint64_t count;
+                    while (read(evfd, &count, sizeof(count)) > 0) {
+                    }
+
+                    std::vector<Completion> completions;
+                    {
+                        std::lock_guard<std::mutex> lock(done_mutex);
+                        completions.swap(done);
+                    }
+
+                    for (auto& comp : completions) {
+                        auto it = conns.find(comp.id);
+                        if (it == conns.end()) {
+                            continue; // 连接已关闭
+                        }
+
+                        Connection& c = it->second;
+                        c.busy = comp.stream != nullptr;
+                        c.stream = std::move(comp.stream);
+                        if (! c.busy) {
+                            c.close_after_write = c.close_after_write || ! comp.keep_alive;
+                        }
+                        c.last_active = std::chrono::steady_clock::now();
+                        c.out.push(std::move(comp.response));
+                        finish(comp.id, c);
+                    }
+                    continue;
                 }
-                else {
-                    result = new_err_result(404, "Only support POST /method/invoke, POST /method/list, POST /coverage/save ！");
+
+                auto it = conns.find(id);
+                if (it == conns.end()) {
+                    continue;
                 }
 
-                response_json = result.dump(-1, ' ', false, nlohmann::detail::error_handler_t::ignore);
-            }
-            else if (! isOpt) {
-                response_json = R"({
-                    "code": 400,
-                    "msg": "Only support HTTP POST Method！"
-                })";
-            }
+                Connection& c = it->second;
+                if (flags & EPOLLERR) {
+                    close_conn(id);
+                    continue;
+                }
+                c.last_active = std::chrono::steady_clock::now();
+
+                if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                    bool error = false;
+                    while (true) {
+                        char* buffer = c.parser.prepare(16 * 1024);
+                        ssize_t r = recv(c.fd, buffer, 16 * 1024, 0);
+                        if (r > 0) {
+                            c.parser.commit(r);
+                            continue;
+                        }
+                        if (r == 0) {
+                            c.peer_closed = true;
+                        } else if (errno == EINTR) {
+                            continue;
+                        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            error = true;
+                        }
+                        break;
+                    }
 
-            // 构建 HTTP 响应
-            std::ostringstream response;
-            response << "HTTP/1.1 " << status << " OK\r\n";
-            response << "Content-Type: application/json\r\n";
-            response << "Access-Control-Allow-Origin:" + host + "\n";
-            response << "Access-Control-Allow-Credentials: true\r\n";
-            response << "Access-Control-Allow-Headers: content-type\r\n";
-            response << "Access-Control-Request-Method: POST\r\n";
-            response << "Content-Length: " << response_json.size() << "\r\n";
-            if (location.length() > 0) {
-                response << location << "\r\n";
-            }
+                    if (error || c.parser.buffered() > SERVER_MAX_REQUEST_SIZE + SERVER_MAX_HEADER_SIZE) {
+                        close_conn(id);
+                        continue;
+                    }
 
-            response << "\r\n";
-            response << response_json;
+                }
 
-            // 发送响应
-            send(client_socket, response.str().c_str(), response.str().size(), 0);
+                finish(id, c);
+            }
         }
 
-        close(client_socket);
-    }
-
-    static bool running = true;
-    static void handle_signal(int signal) {
-        if (signal == SIGINT) {
-            running = false;
+        // 先取消流式输出，再等工作线程处理完，它们还会访问 done 和 evfd
+        for (auto& kv : conns) {
+            if (kv.second.stream) {
+                kv.second.stream->cancel();
+            }
         }
+        pool.shutdown();
+        for (auto& kv : conns) {
+            close(kv.second.fd);
+        }
+        SERVER_ACTIVE_CONNECTIONS -= static_cast<int64_t>(conns.size());
+        close(evfd);
+        close(epfd);
+        return ret;
     }
+#endif
 
     static int start(int port) { // C++ 不支持重载方法
         port = port <= 0 ? 8084 : port;
 
         int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
         sockaddr_in server_addr;
         server_addr.sin_family = AF_INET;
         server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -1818,39 +5036,23 @@ namespace unitauto {
             return -1;
         }
 
-        std::cout << "Server is running on port " << port << "..." << std::endl;
+        WorkerPool pool(SERVER_THREADS, SERVER_QUEUE_SIZE);
+        SERVER_POOL = &pool;
+        std::cout << "Server is running on port " << port << " with " << pool.thread_count() << " threads..." << std::endl;
         signal(SIGINT, handle_signal);
+        signal(SIGPIPE, SIG_IGN); // 客户端提前断开时 send 不应杀死整个进程
 
-        fd_set read_fds;
-        int max_fd = server_socket;
-
-        while (running) {
-            FD_ZERO(&read_fds);
-            FD_SET(server_socket, &read_fds);
-
-            struct timeval timeout;
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 0;
-
-            int activity = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-            if (activity < 0 && errno != EINTR) {
-                std::cerr << "Server select error: " << strerror(errno) << std::endl;
-                break;
-            }
-
-            if (activity > 0 && FD_ISSET(server_socket, &read_fds)) {
-                int client_socket = accept(server_socket, nullptr, nullptr);
-                if (client_socket >= 0) {
-                    handle_request(client_socket);
-                } else {
-                    std::cerr << "Server sccept error: " << strerror(errno) << std::endl;
-                }
-            }
-        }
+#ifdef __linux__
+        int ret = serve_epoll(server_socket, pool);
+#else
+        int ret = serve_select(server_socket, pool);
+#endif
 
+        pool.shutdown();
+        SERVER_POOL = nullptr;
         close(server_socket);
         std::cout << "Server stopped!" << std::endl;
-        return 0;
+        return ret;
     }
 
     // template<typename Type>
@@ -2094,3 +5296,116 @@ namespace unitauto {
         // friend void from_json(const nlohmann::json& nlohmann_json_j, Type nlohmann_json_t) { const Type nlohmann_json_default_obj{}; NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(NLOHMANN_JSON_FROM_WITH_DEFAULT, __VA_ARGS__)) }
 
 }
+
+#ifdef UNITAUTO_ALLOC_HOOK
+// 替换全局 operator new/delete，在 unitauto::ALLOC_STATS.active 时统计当前线程的分配，只能在一个翻译单元中定义
+#include <cstdlib>
+#include <new>
+
+static void* unitauto_alloc(std::size_t size, std::size_t align = 0) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    void* p;
+    if (align > alignof(std::max_align_t)) {
+        p = std::aligned_alloc(align, (size + align - 1) / align * align);
+    } else {
+        p = std::malloc(size);
+    }
+
+    if (p != nullptr && unitauto::ALLOC_STATS.active) {
+        unitauto::ALLOC_STATS.allocs ++;
+        unitauto::ALLOC_STATS.bytes += size;
+    }
+    return p;
+}
+
+static void unitauto_free(void* p) noexcept {
+    if (p == nullptr) {
+        return;
+    }
+    if (unitauto::ALLOC_STATS.active) {
+        unitauto::ALLOC_STATS.frees ++;
+    }
+    std::free(p);
+}
+
+// 分配失败时按标准循环调用 new_handler，直到分配成功；没有设置 new_handler 时抛出 std::bad_alloc
+static void* unitauto_new(std::size_t size, std::size_t align = 0) {
+    while (true) {
+        void* p = unitauto_alloc(size, align);
+        if (p != nullptr) {
+            return p;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new(std::size_t size) {
+    return unitauto_new(size);
+}
+
+void* operator new[](std::size_t size) {
+    return unitauto_new(size);
+}
+
+// nothrow 版本同样会调用 new_handler，new_handler 抛出 std::bad_alloc 时返回 nullptr
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return unitauto_new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return unitauto_new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    return unitauto_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return unitauto_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    try {
+        return unitauto_new(size, static_cast<std::size_t>(align));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    try {
+        return unitauto_new(size, static_cast<std::size_t>(align));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept { unitauto_free(p); }
+void operator delete[](void* p) noexcept { unitauto_free(p); }
+void operator delete(void* p, std::size_t) noexcept { unitauto_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { unitauto_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { unitauto_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { unitauto_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { unitauto_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { unitauto_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { unitauto_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { unitauto_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { unitauto_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { unitauto_free(p); }
+#endif
@@ -0,0 +1,151 @@
+#include <string>
+#include <string_view>
+
+// HTTP 解析、Accept 协商、ETag 的回归检查，需要在 method_util.hpp 之后引入
+namespace unitauto::test {
+
+    // 检查结果不符合预期时打印错误，返回是否通过
+    template <typename T>
+    static bool check(const std::string &name, const T &actual, const T &expected) {
+        if (actual == expected) {
+            unitauto::println("PASS ", name);
+            return true;
+        }
+        unitauto::printlnErr("FAIL ", name, ": ", actual, " != ", expected);
+        return false;
+    }
+
+    // 一次性解析 raw，COMPLETE 时取出请求，ERROR 时返回错误码，NEED_MORE 时返回 0
+    static int parse_http(const std::string &raw, unitauto::HttpRequest *req = nullptr) {
+        unitauto::HttpParser parser;
+        parser.append(raw.data(), raw.size());
+        auto status = parser.parse();
+        if (status == unitauto::HttpParser::ERROR) {
+            return parser.error_status();
+        }
+        if (status == unitauto::HttpParser::NEED_MORE) {
+            return 0;
+        }
+        if (req != nullptr) {
+            parser.take(*req);
+        }
+        return 200;
+    }
+
+    // 请求解析及请求走私(报文边界有歧义)的回归检查，返回失败数
+    static int test_http_parser() {
+        int failed = 0;
+        const std::string head = "POST /method/invoke HTTP/1.1\r\nHost: localhost\r\n";
+
+        unitauto::HttpRequest req;
+        failed += ! check<int>("Content-Length", parse_http(head + "Content-Length: 2\r\n\r\n{}", &req), 200);
+        failed += ! check<std::string>("Content-Length body", std::string(req.body), "{}");
+        failed += ! check<int>("incomplete body", parse_http(head + "Content-Length: 5\r\n\r\n{}"), 0);
+
+        unitauto::HttpRequest chunked;
+        failed += ! check<int>("chunked", parse_http(head + "Transfer-Encoding: chunked\r\n\r\n1\r\n{\r\n1\r\n}\r\n0\r\n\r\n", &chunked), 200);
+        failed += ! check<std::string>("chunked body", std::string(chunked.body), "{}");
+        failed += ! check<int>("Chunked case", parse_http(head + "Transfer-Encoding: Chunked\r\n\r\n0\r\n\r\n"), 200);
+
+        // 管线化：一次收到两个请求，取出第一个后剩下的仍可继续解析
+        unitauto::HttpParser parser;
+        std::string two = head + "Content-Length: 1\r\n\r\n1" + head + "Content-Length: 1\r\n\r\n2";
+        parser.append(two.data(), two.size());
+        unitauto::HttpRequest first, second;
+        failed += ! check<int>("pipelined first", parser.parse(), unitauto::HttpParser::COMPLETE);
+        parser.take(first);
+        failed += ! check<int>("pipelined second", parser.parse(), unitauto::HttpParser::COMPLETE);
+        parser.take(second);
+        failed += ! check<std::string>("pipelined bodies", std::string(first.body) + std::string(second.body), "12");
+
+        // 分多次到达
+        unitauto::HttpParser split;
+        std::string one = head + "Content-Length: 2\r\n\r\n{}";
+        int status = unitauto::HttpParser::NEED_MORE;
+        for (size_t i = 0; i < one.size() && status == unitauto::HttpParser::NEED_MORE; i ++) {
+            split.append(one.data() + i, 1);
+            status = split.parse();
+        }
+        failed += ! check<int>("byte by byte", status, unitauto::HttpParser::COMPLETE);
+
+        failed += ! check<int>("duplicate equal Content-Length", parse_http(head + "Content-Length: 2\r\nContent-Length: 2\r\n\r\n{}"), 200);
+        failed += ! check<int>("conflicting Content-Length", parse_http(head + "Content-Length: 2\r\nContent-Length: 3\r\n\r\n{}"), 400);
+        failed += ! check<int>("Content-Length with Transfer-Encoding",
+                parse_http(head + "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n"), 400);
+        failed += ! check<int>("chunked not final", parse_http(head + "Transfer-Encoding: chunked, gzip\r\n\r\n0\r\n\r\n"), 400);
+        failed += ! check<int>("empty Transfer-Encoding", parse_http(head + "Transfer-Encoding: \r\n\r\n"), 400);
+        failed += ! check<int>("gzip then chunked", parse_http(head + "Transfer-Encoding: gzip, chunked\r\n\r\n0\r\n\r\n"), 501);
+        failed += ! check<int>("unknown Transfer-Encoding", parse_http(head + "Transfer-Encoding: xchunkedx\r\n\r\n0\r\n\r\n"), 501);
+        return failed;
+    }
+
+    // Accept 按 q 值协商响应体编码的回归检查，返回失败数
+    static int test_accept_format() {
+        int failed = 0;
+        failed += ! check<int>("no Accept", unitauto::accept_format("", unitauto::FORMAT_CBOR), unitauto::FORMAT_CBOR);
+        failed += ! check<int>("*/*", unitauto::accept_format("*/*", unitauto::FORMAT_MSGPACK), unitauto::FORMAT_MSGPACK);
+        failed += ! check<int>("highest q", unitauto::accept_format("application/cbor;q=0.5, application/msgpack;q=0.8",
+                unitauto::FORMAT_JSON), unitauto::FORMAT_MSGPACK);
+        failed += ! check<int>("default q=1", unitauto::accept_format("application/cbor;q=0.9, application/json",
+                unitauto::FORMAT_CBOR), unitauto::FORMAT_JSON);
+        failed += ! check<int>("q=0 refuses default", unitauto::accept_format("application/msgpack;q=0, */*",
+                unitauto::FORMAT_MSGPACK), unitauto::FORMAT_JSON);
+        failed += ! check<int>("exact type over */*", unitauto::accept_format("*/*;q=0.1, application/cbor",
+                unitauto::FORMAT_JSON), unitauto::FORMAT_CBOR);
+        return failed;
+    }
+
+    // 取响应头中的 ETag，没有时返回空
+    static std::string response_etag(const std::string &head) {
+        auto start = head.find("\r\nETag: ");
+        if (start == std::string::npos) {
+            return "";
+        }
+        start += 8;
+        return head.substr(start, head.find("\r\n", start) - start);
+    }
+
+    static std::string status_line(const std::string &head) {
+        return head.substr(0, head.find("\r\n"));
+    }
+
+    // 每种压缩编码用不同 ETag 的回归检查，返回失败数；需要先注册函数，使 /method/list 足够大
+    static int test_etag() {
+        int failed = 0;
+        failed += ! check<std::string>("identity ETag", unitauto::encoded_etag("\"1-2\"", unitauto::ENCODING_IDENTITY), "\"1-2\"");
+        failed += ! check<std::string>("gzip ETag", unitauto::encoded_etag("\"1-2\"", unitauto::ENCODING_GZIP), "\"1-2-gzip\"");
+        failed += ! check<std::string>("deflate ETag", unitauto::encoded_etag("\"1-2\"", unitauto::ENCODING_DEFLATE), "\"1-2-deflate\"");
+
+        const std::string list = "POST /method/list HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n";
+        auto request = [&list](const std::string &headers) {
+            unitauto::HttpRequest req;
+            parse_http(list + headers + "\r\n", &req);
+            bool keep_alive = true;
+            return unitauto::handle_http(req, keep_alive).head;
+        };
+
+        std::string etag = response_etag(request(""));
+        failed += ! check<bool>("list ETag", etag.empty(), false);
+        failed += ! check<std::string>("identity If-None-Match", status_line(request("If-None-Match: " + etag + "\r\n")),
+                "HTTP/1.1 304 Not Modified");
+
+        // 按 Accept-Encoding 协商出的编码不同，原文的 ETag 不能匹配压缩后的表示
+        const std::string gzip = "Accept-Encoding: gzip\r\n";
+        std::string gzip_etag = response_etag(request(gzip));
+        bool compressed = gzip_etag != etag;
+        if (compressed) {
+            failed += ! check<std::string>("gzip list ETag", gzip_etag, unitauto::encoded_etag(etag, unitauto::ENCODING_GZIP));
+            failed += ! check<std::string>("identity ETag with gzip", status_line(request(gzip + "If-None-Match: " + etag + "\r\n")),
+                    "HTTP/1.1 200 OK");
+        }
+        failed += ! check<std::string>("negotiated If-None-Match", status_line(request(gzip + "If-None-Match: " + gzip_etag + "\r\n")),
+                "HTTP/1.1 304 Not Modified");
+        return failed;
+    }
+
+    // 运行以上所有检查，返回失败数
+    static int test_http() {
+        return test_http_parser() + test_accept_format() + test_etag();
+    }
+
+}